@@ -347,11 +347,12 @@ struct FuncDef : public AstNode
     std::vector<ParamPtr> params;
     std::optional<Type> return_type;
     BlockPtr block;
-    bool is_const;
+    bool is_const, is_exported;
 
     constexpr FuncDef(const std::wstring &name, std::vector<ParamPtr> params,
                       const std::optional<Type> &return_type, BlockPtr block,
-                      const bool &is_const, const Position &position) noexcept;
+                      const bool &is_const, const Position &position,
+                      const bool &is_exported = false) noexcept;
 };
 
 struct ExternDef : public AstNode
@@ -621,9 +622,11 @@ constexpr FuncDef::FuncDef(const std::wstring &name,
                            std::vector<ParamPtr> params,
                            const std::optional<Type> &return_type,
                            BlockPtr block, const bool &is_const,
-                           const Position &position) noexcept
+                           const Position &position,
+                           const bool &is_exported) noexcept
     : AstNode(position), name(name), params(std::move(params)),
-      return_type(return_type), block(std::move(block)), is_const(is_const)
+      return_type(return_type), block(std::move(block)), is_const(is_const),
+      is_exported(is_exported)
 {
 }
 
@@ -813,6 +816,7 @@ constexpr bool operator==(const FuncDef &first, const FuncDef &other) noexcept
            compare_ptr_vectors(first.params, other.params) &&
            first.return_type == other.return_type && equal_blocks &&
            first.is_const == other.is_const &&
+           first.is_exported == other.is_exported &&
            first.position == other.position;
 }
 
@@ -0,0 +1,43 @@
+#ifndef __COMPILATION_CACHE_HPP__
+#define __COMPILATION_CACHE_HPP__
+#include "logger.hpp"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Content-addressed store of the compiler's outputs, which can be shared by
+// concurrently running compilers. Entries are written to temporary files
+// first and then renamed, so they appear all at once, and the least recently
+// used ones are evicted once the directory outgrows its size limit. Failing
+// to read or write the cache never fails the compilation itself.
+class CompilationCache : public Reporter
+{
+    std::filesystem::path directory;
+    std::uintmax_t max_size;
+    std::atomic<std::size_t> hits, misses;
+
+    void evict();
+
+  public:
+    CompilationCache(const std::filesystem::path &directory,
+                     const std::uintmax_t &max_size);
+
+    // The options should contain everything besides the source that affects
+    // the output. Line endings and trailing whitespace outside of string and
+    // char literals are normalized, so they don't change the key.
+    static std::string get_key(const std::string &source,
+                               const std::vector<std::string> &options);
+
+    // Copies the entry to the output path, returns false on a miss.
+    bool load(const std::string &key, const std::filesystem::path &output);
+    void store(const std::string &key, const std::filesystem::path &output);
+    std::optional<std::string> load_data(const std::string &key);
+    void store_data(const std::string &key, const std::string &data);
+    std::size_t get_hits() const noexcept;
+    std::size_t get_misses() const noexcept;
+    void report_stats();
+};
+#endif
\ No newline at end of file
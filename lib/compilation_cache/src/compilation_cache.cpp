@@ -0,0 +1,242 @@
+#include "compilation_cache.hpp"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SHA256.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+enum class SourceState
+{
+    CODE,
+    STRING,
+    CHAR,
+    LINE_COMMENT,
+    BLOCK_COMMENT
+};
+
+// Trailing whitespace is only dropped outside of string and char literals,
+// as it's part of their value. Comments are tracked too, so that the quotes
+// inside them don't start a literal.
+std::string normalize_source(const std::string &source)
+{
+    std::string result, whitespace;
+    auto state = SourceState::CODE;
+    for (std::size_t i = 0; i < source.size(); ++i)
+    {
+        auto current = source[i];
+        auto next = (i + 1 < source.size()) ? (source[i + 1]) : ('\0');
+        if (state == SourceState::STRING || state == SourceState::CHAR)
+        {
+            result += current;
+            auto quote = (state == SourceState::STRING) ? ('"') : ('\'');
+            if (current == '\\' && i + 1 < source.size())
+                result += source[++i];
+            else if (current == quote)
+                state = SourceState::CODE;
+            continue;
+        }
+        if (current == ' ' || current == '\t' || current == '\r')
+        {
+            whitespace += current;
+            continue;
+        }
+        if (current != '\n')
+            result += whitespace;
+        whitespace.clear();
+        result += current;
+        if (current == '\n')
+        {
+            if (state == SourceState::LINE_COMMENT)
+                state = SourceState::CODE;
+        }
+        else if (state == SourceState::BLOCK_COMMENT)
+        {
+            if (current == '*' && next == '/')
+            {
+                result += source[++i];
+                state = SourceState::CODE;
+            }
+        }
+        else if (state == SourceState::CODE)
+        {
+            if (current == '"')
+                state = SourceState::STRING;
+            else if (current == '\'')
+                state = SourceState::CHAR;
+            else if (current == '/' && (next == '/' || next == '*'))
+            {
+                result += source[++i];
+                state = (next == '/') ? (SourceState::LINE_COMMENT)
+                                      : (SourceState::BLOCK_COMMENT);
+            }
+        }
+    }
+    if (!result.empty() && result.back() != '\n')
+        result += '\n';
+    return result;
+}
+
+bool is_temporary(const std::filesystem::path &path)
+{
+    return path.filename().string().starts_with("tmp-");
+}
+
+struct CacheEntry
+{
+    std::filesystem::path path;
+    std::filesystem::file_time_type write_time;
+    std::uintmax_t size;
+};
+} // namespace
+
+CompilationCache::CompilationCache(const std::filesystem::path &directory,
+                                   const std::uintmax_t &max_size)
+    : directory(directory), max_size(max_size), hits(0), misses(0)
+{
+}
+
+// The parts are separated with null characters, which can't appear in any of
+// them, so that moving text from one part to another changes the key.
+std::string CompilationCache::get_key(const std::string &source,
+                                      const std::vector<std::string> &options)
+{
+    auto data = normalize_source(source);
+    for (const auto &option : options)
+    {
+        data += '\0';
+        data += option;
+    }
+    return llvm::toHex(llvm::SHA256::hash(llvm::arrayRefFromStringRef(data)),
+                       true);
+}
+
+bool CompilationCache::load(const std::string &key,
+                            const std::filesystem::path &output)
+{
+    auto entry = this->directory / key;
+    std::error_code ec;
+    std::filesystem::copy_file(
+        entry, output, std::filesystem::copy_options::overwrite_existing, ec);
+    if (ec)
+    {
+        ++this->misses;
+        return false;
+    }
+    // the entry's time is refreshed, so that it's evicted as recently used
+    std::filesystem::last_write_time(
+        entry, std::filesystem::file_time_type::clock::now(), ec);
+    ++this->hits;
+    return true;
+}
+
+std::optional<std::string> CompilationCache::load_data(const std::string &key)
+{
+    auto entry = this->directory / key;
+    auto input = std::ifstream(entry, std::ios::binary);
+    if (!input.good())
+    {
+        ++this->misses;
+        return std::nullopt;
+    }
+    auto data = std::string(std::istreambuf_iterator<char>(input), {});
+    std::error_code ec;
+    std::filesystem::last_write_time(
+        entry, std::filesystem::file_time_type::clock::now(), ec);
+    ++this->hits;
+    return data;
+}
+
+void CompilationCache::store(const std::string &key,
+                             const std::filesystem::path &output)
+{
+    auto input = std::ifstream(output, std::ios::binary);
+    if (input.good())
+        this->store_data(
+            key, std::string(std::istreambuf_iterator<char>(input), {}));
+}
+
+// Every writer writes to a temporary file of its own, so that processes
+// storing the same entry don't overwrite each other's partial files, and the
+// rename then replaces the entry atomically.
+void CompilationCache::store_data(const std::string &key,
+                                  const std::string &data)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(this->directory, ec);
+    llvm::SmallString<128> temporary;
+    llvm::sys::fs::createUniquePath(
+        (this->directory / "tmp-%%%%%%%%%%%%%%%%").string(), temporary,
+        false);
+    auto temporary_path = std::filesystem::path(temporary.str().str());
+    {
+        auto output = std::ofstream(temporary_path, std::ios::binary);
+        output << data;
+        if (!output.good())
+        {
+            output.close();
+            std::filesystem::remove(temporary_path, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary_path, this->directory / key, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temporary_path, ec);
+        return;
+    }
+    this->evict();
+}
+
+// Other processes may evict the same entries at the same time, so an entry
+// that can't be read or removed is skipped instead of failing the eviction.
+void CompilationCache::evict()
+{
+    std::vector<CacheEntry> entries;
+    std::uintmax_t size = 0;
+    std::error_code ec;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(this->directory, ec))
+    {
+        if (!entry.is_regular_file(ec) || is_temporary(entry.path()))
+            continue;
+        auto write_time = entry.last_write_time(ec);
+        if (ec)
+            continue;
+        auto entry_size = entry.file_size(ec);
+        if (ec)
+            continue;
+        entries.push_back({entry.path(), write_time, entry_size});
+        size += entry_size;
+    }
+    if (size <= this->max_size)
+        return;
+
+    std::ranges::sort(entries, {}, &CacheEntry::write_time);
+    for (const auto &entry : entries)
+    {
+        if (size <= this->max_size)
+            break;
+        if (std::filesystem::remove(entry.path, ec))
+            size -= entry.size;
+    }
+}
+
+std::size_t CompilationCache::get_hits() const noexcept
+{
+    return this->hits;
+}
+
+std::size_t CompilationCache::get_misses() const noexcept
+{
+    return this->misses;
+}
+
+void CompilationCache::report_stats()
+{
+    this->report(LogLevel::INFO, std::nullopt, L"Compilation cache: ",
+                 this->hits.load(), L" hits, ", this->misses.load(),
+                 L" misses.");
+}
\ No newline at end of file
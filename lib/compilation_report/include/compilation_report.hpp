@@ -0,0 +1,76 @@
+#ifndef __COMPILATION_REPORT_HPP__
+#define __COMPILATION_REPORT_HPP__
+#include "ast.hpp"
+#include "semantic_checker.hpp"
+#include <cstdint>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/Timer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Times the phases of a single file's compilation and the optimization passes
+// run on it, and collects counts describing the compiled program. The memory
+// allocated during every phase is only measured if LLVM's `-track-memory`
+// option is set.
+class CompilationReport
+{
+    llvm::TimerGroup phases, passes;
+    llvm::StringMap<std::unique_ptr<llvm::Timer>> phase_timers, pass_timers;
+    // the passes running inside other ones pause the outer ones' timers
+    std::vector<llvm::Timer *> running_passes;
+
+    struct Count
+    {
+        std::string name, description;
+        std::uint64_t value;
+    };
+
+    std::vector<Count> counts;
+
+  public:
+    CompilationReport();
+    CompilationReport(const CompilationReport &) = delete;
+    ~CompilationReport();
+
+    // The timer is created on the first call, the following calls with the
+    // same name return the same one.
+    llvm::Timer &get_phase_timer(const std::string &name,
+                                 const std::string &description);
+    void register_callbacks(llvm::PassInstrumentationCallbacks &callbacks);
+    void add_count(const std::string &name, const std::string &description,
+                   const std::uint64_t &value);
+
+    // Both of them reset the timers.
+    void print(llvm::raw_ostream &output);
+    void print_json(llvm::raw_ostream &output);
+};
+
+// Phase of a compilation lasting until it's destroyed. It's timed with the
+// given timer, if there's one, and added to the time trace, if it's enabled.
+class CompilationPhase
+{
+    llvm::TimeRegion region;
+    llvm::TimeTraceScope scope;
+
+  public:
+    CompilationPhase(llvm::Timer *timer, const std::string &description);
+};
+
+// Adds the checking of every function to the time trace, if it's enabled.
+class FunctionCheckTracer : public CheckObserver
+{
+  public:
+    void enter_function(const FuncDef &node) override;
+    void leave_function(const FuncDef &node) override;
+};
+
+// Counts every node of the tree, the program itself included.
+std::size_t count_nodes(const Program &program);
+
+// Peak resident memory of the whole process in bytes.
+std::uint64_t get_peak_memory();
+#endif
\ No newline at end of file
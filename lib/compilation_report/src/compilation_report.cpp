@@ -0,0 +1,262 @@
+#include "compilation_report.hpp"
+#include "overloaded.hpp"
+#include <algorithm>
+#include <llvm/Support/Format.h>
+#include <sys/resource.h>
+
+namespace
+{
+// the same passes as in LLVM's -time-passes only run the other ones
+bool is_container(const llvm::StringRef &pass)
+{
+    return llvm::isSpecialPass(
+        pass, {"PassManager", "PassAdaptor", "AnalysisManagerProxy",
+               "ModuleInlinerWrapperPass", "DevirtSCCRepeatedPass"});
+}
+
+std::size_t count_nodes(const Expression &node);
+std::size_t count_nodes(const Statement &node);
+
+std::size_t count_nodes(const std::vector<ExprPtr> &nodes)
+{
+    std::size_t result = 0;
+    for (const auto &node : nodes)
+        result += count_nodes(*node);
+    return result;
+}
+
+std::size_t count_nodes(const Expression &node)
+{
+    return 1 + std::visit(overloaded{[](const BinaryExpr &node) {
+                                         return count_nodes(*node.lhs) +
+                                                count_nodes(*node.rhs);
+                                     },
+                                     [](const UnaryExpr &node) {
+                                         return count_nodes(*node.expr);
+                                     },
+                                     [](const CallExpr &node) {
+                                         return count_nodes(node.args);
+                                     },
+                                     [](const IndexExpr &node) {
+                                         return count_nodes(*node.expr) +
+                                                count_nodes(*node.index_value);
+                                     },
+                                     [](const CastExpr &node) {
+                                         return count_nodes(*node.expr);
+                                     },
+                                     [](const auto &) -> std::size_t {
+                                         return 0;
+                                     }},
+                          node);
+}
+
+std::size_t count_nodes(const ExprPtr &node)
+{
+    return (node) ? (count_nodes(*node)) : (0);
+}
+
+std::size_t count_nodes(const StmtPtr &node)
+{
+    return (node) ? (count_nodes(*node)) : (0);
+}
+
+std::size_t count_nodes(const MatchArm &node)
+{
+    return 1 + std::visit(overloaded{[](const LiteralArm &node) {
+                                         return count_nodes(node.literals) +
+                                                count_nodes(node.block);
+                                     },
+                                     [](const GuardArm &node) {
+                                         return count_nodes(
+                                                    node.condition_expr) +
+                                                count_nodes(node.block);
+                                     },
+                                     [](const ElseArm &node) {
+                                         return count_nodes(node.block);
+                                     }},
+                          node);
+}
+
+std::size_t count_nodes(const Block &node)
+{
+    std::size_t result = 1;
+    for (const auto &stmt : node.statements)
+        result += count_nodes(*stmt);
+    return result;
+}
+
+std::size_t count_nodes(const VarDeclStmt &node)
+{
+    return 1 + count_nodes(node.initial_value);
+}
+
+std::size_t count_nodes(const Statement &node)
+{
+    return std::visit(
+        overloaded{
+            [](const Block &node) { return count_nodes(node); },
+            [](const ReturnStmt &node) { return 1 + count_nodes(node.expr); },
+            [](const VarDeclStmt &node) { return count_nodes(node); },
+            [](const AssignStmt &node) {
+                return 1 + count_nodes(node.lhs) + count_nodes(node.rhs);
+            },
+            [](const ExprStmt &node) { return 1 + count_nodes(node.expr); },
+            [](const WhileStmt &node) {
+                return 1 + count_nodes(node.condition_expr) +
+                       count_nodes(node.statement);
+            },
+            [](const IfStmt &node) {
+                return 1 + count_nodes(node.condition_expr) +
+                       count_nodes(node.then_block) +
+                       count_nodes(node.else_block);
+            },
+            [](const MatchStmt &node) {
+                auto result = 1 + count_nodes(node.matched_expr);
+                for (const auto &arm : node.match_arms)
+                    result += count_nodes(*arm);
+                return result;
+            },
+            [](const auto &) -> std::size_t { return 1; }},
+        node);
+}
+} // namespace
+
+CompilationReport::CompilationReport()
+    : phases("phases", "Mole compilation phases"),
+      passes("passes", "Mole optimization passes")
+{
+}
+
+// Timers that ran are printed by LLVM once they're destroyed, unless they're
+// reset first.
+CompilationReport::~CompilationReport()
+{
+    this->phases.clear();
+    this->passes.clear();
+}
+
+llvm::Timer &CompilationReport::get_phase_timer(const std::string &name,
+                                                const std::string &description)
+{
+    auto &timer = this->phase_timers[name];
+    if (!timer)
+        timer = std::make_unique<llvm::Timer>(name, description, this->phases);
+    return *timer;
+}
+
+void CompilationReport::register_callbacks(
+    llvm::PassInstrumentationCallbacks &callbacks)
+{
+    callbacks.registerBeforeNonSkippedPassCallback(
+        [this](llvm::StringRef pass, llvm::Any) {
+            if (is_container(pass))
+                return;
+            auto &timer = this->pass_timers[pass];
+            if (!timer)
+                timer = std::make_unique<llvm::Timer>(pass, pass,
+                                                      this->passes);
+            if (!this->running_passes.empty())
+                this->running_passes.back()->stopTimer();
+            this->running_passes.push_back(timer.get());
+            timer->startTimer();
+        });
+    auto stop_pass = [this](llvm::StringRef pass) {
+        if (is_container(pass) || this->running_passes.empty())
+            return;
+        this->running_passes.back()->stopTimer();
+        this->running_passes.pop_back();
+        if (!this->running_passes.empty())
+            this->running_passes.back()->startTimer();
+    };
+    callbacks.registerAfterPassCallback(
+        [stop_pass](llvm::StringRef pass, llvm::Any,
+                    const llvm::PreservedAnalyses &) { stop_pass(pass); });
+    callbacks.registerAfterPassInvalidatedCallback(
+        [stop_pass](llvm::StringRef pass, const llvm::PreservedAnalyses &) {
+            stop_pass(pass);
+        });
+}
+
+void CompilationReport::add_count(const std::string &name,
+                                  const std::string &description,
+                                  const std::uint64_t &value)
+{
+    this->counts.push_back(Count{name, description, value});
+}
+
+// The counts are printed the same way as LLVM's statistics.
+void CompilationReport::print(llvm::raw_ostream &output)
+{
+    this->phases.print(output, true);
+    this->passes.print(output, true);
+    if (this->counts.empty())
+        return;
+
+    std::size_t width = 0;
+    for (const auto &count : this->counts)
+        width = std::max(width, std::to_string(count.value).size());
+    auto separator = "===" + std::string(73, '-') + "===\n";
+    std::string title = "Mole compilation counts";
+    output << separator << std::string((80 - title.size()) / 2, ' ') << title
+           << '\n'
+           << separator << '\n';
+    for (const auto &count : this->counts)
+        output << llvm::format_decimal(count.value, width) << ' '
+               << count.name << " - " << count.description << '\n';
+    output << '\n';
+}
+
+// The keys follow LLVM's `-stats-json` format.
+void CompilationReport::print_json(llvm::raw_ostream &output)
+{
+    output << "{\n";
+    auto delimiter = this->phases.printJSONValues(output, "");
+    delimiter = this->passes.printJSONValues(output, delimiter);
+    for (const auto &count : this->counts)
+    {
+        output << delimiter << "\t\"counts." << count.name
+               << "\": " << count.value;
+        delimiter = ",\n";
+    }
+    output << "\n}\n";
+    this->phases.clear();
+    this->passes.clear();
+}
+
+CompilationPhase::CompilationPhase(llvm::Timer *timer,
+                                   const std::string &description)
+    : region(timer), scope(description)
+{
+}
+
+void FunctionCheckTracer::enter_function(const FuncDef &node)
+{
+    // the name is only converted if the time trace is enabled
+    llvm::timeTraceProfilerBegin("CheckFunction", [&node] {
+        return std::string(node.name.cbegin(), node.name.cend());
+    });
+}
+
+void FunctionCheckTracer::leave_function(const FuncDef &)
+{
+    llvm::timeTraceProfilerEnd();
+}
+
+std::size_t count_nodes(const Program &program)
+{
+    std::size_t result = 1 + program.externs.size();
+    for (const auto &var : program.globals)
+        result += count_nodes(*var);
+    for (const auto &func : program.functions)
+        result += 1 + func->params.size() + count_nodes(*func->block);
+    return result;
+}
+
+std::uint64_t get_peak_memory()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    // reported in kilobytes
+    return std::uint64_t(usage.ru_maxrss) << 10;
+}
\ No newline at end of file
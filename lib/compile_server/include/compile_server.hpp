@@ -0,0 +1,85 @@
+#ifndef __COMPILE_SERVER_HPP__
+#define __COMPILE_SERVER_HPP__
+#include "compiled_program.hpp"
+#include "llvm/Support/ThreadPool.h"
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class OutputKind
+{
+    OBJECT,
+    IR,
+    BYTECODE
+};
+
+// Compilation of a single file. The paths should be absolute, as the server
+// doesn't share the client's working directory. Requests of a different
+// version than the server's one are never handled.
+struct CompileRequest
+{
+    std::string version, path, output_path;
+    OutputKind kind = OutputKind::OBJECT;
+    llvm::OptimizationLevel level = llvm::OptimizationLevel::O0;
+    CompilationTarget target;
+    bool no_warnings = false;
+    unsigned threads = 1;
+    bool debug_info = false;
+};
+
+struct CompileResponse
+{
+    int status;
+    std::wstring diagnostics;
+};
+
+// Socket private to the current user, in the runtime directory if there's
+// one.
+std::filesystem::path get_default_socket_path();
+
+// Returns nothing if no server listens on the socket or it didn't handle the
+// request, in which case the file should be compiled in-process.
+std::optional<CompileResponse> send_request(
+    const std::filesystem::path &socket_path, const CompileRequest &request);
+
+// Compiles the files it's sent over a Unix domain socket concurrently, so
+// that the LLVM targets are initialized only once. The target machines are
+// pooled and reused by the following requests for the same target.
+class CompileServer
+{
+    std::filesystem::path socket_path;
+    std::string version;
+    int socket;
+    std::atomic<bool> is_stopped;
+    std::mutex machines_mutex;
+    std::unordered_map<std::string,
+                       std::vector<std::unique_ptr<llvm::TargetMachine>>>
+        machines;
+    llvm::ThreadPool pool;
+
+    std::unique_ptr<llvm::TargetMachine> acquire_target_machine(
+        const CompilationTarget &target);
+    void release_target_machine(
+        std::unique_ptr<llvm::TargetMachine> target_machine);
+    int compile(const CompileRequest &request, std::wostream &diagnostics);
+    void handle(const int &connection);
+
+  public:
+    // Starts listening right away. Throws an `std::system_error` if another
+    // server already listens on the socket or it can't be created.
+    CompileServer(const std::filesystem::path &socket_path,
+                  const std::string &version, const unsigned &threads);
+    CompileServer(const CompileServer &) = delete;
+    ~CompileServer();
+
+    // Handles the requests until the server is stopped.
+    void serve();
+    void stop();
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,437 @@
+#include "compile_server.hpp"
+#include "dead_code_eliminator.hpp"
+#include "parser.hpp"
+#include "semantic_checker.hpp"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/raw_ostream.h"
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace
+{
+// a malformed message can't make the server allocate more than that
+constexpr std::uint32_t max_field_size = 1 << 26;
+constexpr std::size_t request_fields = 12;
+
+std::system_error get_error(const std::string &what)
+{
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+std::optional<sockaddr_un> get_address(const std::filesystem::path &path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    auto name = path.string();
+    if (name.size() >= sizeof(address.sun_path))
+        return std::nullopt;
+    name.copy(address.sun_path, name.size());
+    return address;
+}
+
+// Both ends only talk to processes of the same user. The server's socket
+// permissions already keep others out, but a socket another user created at
+// the client's path first would get its requests otherwise.
+bool is_peer_trusted(const int &connection)
+{
+    ucred credentials{};
+    socklen_t size = sizeof(credentials);
+    if (::getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials,
+                     &size) < 0)
+        return false;
+    return credentials.uid == ::getuid();
+}
+
+// Returns -1 if nothing listens on the socket, or a server of another user
+// does.
+int connect_to(const std::filesystem::path &path)
+{
+    auto address = get_address(path);
+    if (!address)
+        return -1;
+    auto connection = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0)
+        return -1;
+    if (::connect(connection, reinterpret_cast<const sockaddr *>(&*address),
+                  sizeof(*address)) < 0 ||
+        !is_peer_trusted(connection))
+    {
+        ::close(connection);
+        return -1;
+    }
+    return connection;
+}
+
+// Every field is sent as its size followed by its bytes.
+void put_field(std::string &message, const std::string &field)
+{
+    auto size = static_cast<std::uint32_t>(field.size());
+    message.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    message += field;
+}
+
+bool send_message(const int &connection, const std::string &message)
+{
+    std::size_t sent = 0;
+    while (sent < message.size())
+    {
+        auto result = ::send(connection, message.data() + sent,
+                             message.size() - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        sent += result;
+    }
+    return true;
+}
+
+bool receive(const int &connection, char *data, const std::size_t &size)
+{
+    std::size_t received = 0;
+    while (received < size)
+    {
+        auto result =
+            ::recv(connection, data + received, size - received, 0);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        received += result;
+    }
+    return true;
+}
+
+std::optional<std::string> get_field(const int &connection)
+{
+    std::uint32_t size;
+    if (!receive(connection, reinterpret_cast<char *>(&size), sizeof(size)) ||
+        size > max_field_size)
+        return std::nullopt;
+    auto result = std::string(size, '\0');
+    if (!receive(connection, result.data(), size))
+        return std::nullopt;
+    return result;
+}
+
+std::string get_machine_key(const std::string &triple, const std::string &cpu,
+                            const std::string &features)
+{
+    return triple + '\0' + cpu + '\0' + features;
+}
+
+std::optional<llvm::OptimizationLevel> get_level(const unsigned &speedup,
+                                                 const unsigned &size)
+{
+    for (const auto &level :
+         {llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+          llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3,
+          llvm::OptimizationLevel::Os, llvm::OptimizationLevel::Oz})
+    {
+        if (level.getSpeedupLevel() == speedup &&
+            level.getSizeLevel() == size)
+            return level;
+    }
+    return std::nullopt;
+}
+
+std::string encode_request(const CompileRequest &request)
+{
+    std::string result;
+    for (const auto &field :
+         {request.version, request.path, request.output_path,
+          std::to_string(static_cast<unsigned>(request.kind)),
+          std::to_string(request.level.getSpeedupLevel()),
+          std::to_string(request.level.getSizeLevel()),
+          request.target.triple, request.target.cpu, request.target.features,
+          std::to_string(request.no_warnings),
+          std::to_string(request.threads),
+          std::to_string(request.debug_info)})
+        put_field(result, field);
+    return result;
+}
+
+std::optional<CompileRequest> receive_request(const int &connection)
+{
+    std::array<std::string, request_fields> fields;
+    for (auto &field : fields)
+    {
+        auto received = get_field(connection);
+        if (!received)
+            return std::nullopt;
+        field = std::move(*received);
+    }
+    unsigned kind, speedup, size, no_warnings, threads, debug_info;
+    if (!llvm::to_integer(fields[3], kind) ||
+        kind > static_cast<unsigned>(OutputKind::BYTECODE) ||
+        !llvm::to_integer(fields[4], speedup) ||
+        !llvm::to_integer(fields[5], size) ||
+        !llvm::to_integer(fields[9], no_warnings) ||
+        !llvm::to_integer(fields[10], threads) ||
+        !llvm::to_integer(fields[11], debug_info))
+        return std::nullopt;
+    auto level = get_level(speedup, size);
+    if (!level)
+        return std::nullopt;
+    return CompileRequest{fields[0],
+                          fields[1],
+                          fields[2],
+                          static_cast<OutputKind>(kind),
+                          *level,
+                          CompilationTarget{fields[6], fields[7], fields[8]},
+                          no_warnings != 0,
+                          threads,
+                          debug_info != 0};
+}
+
+// Both ends run on the same machine, so the diagnostics are sent as is.
+std::string encode_response(const CompileResponse &response)
+{
+    std::string result;
+    put_field(result, std::to_string(response.status));
+    put_field(result,
+              std::string(reinterpret_cast<const char *>(
+                              response.diagnostics.data()),
+                          response.diagnostics.size() * sizeof(wchar_t)));
+    return result;
+}
+
+std::optional<CompileResponse> receive_response(const int &connection)
+{
+    auto status = get_field(connection);
+    auto diagnostics = get_field(connection);
+    int value;
+    if (!status || !diagnostics || !llvm::to_integer(*status, value) ||
+        diagnostics->size() % sizeof(wchar_t) != 0)
+        return std::nullopt;
+    return CompileResponse{
+        value, std::wstring(
+                   reinterpret_cast<const wchar_t *>(diagnostics->data()),
+                   diagnostics->size() / sizeof(wchar_t))};
+}
+} // namespace
+
+std::filesystem::path get_default_socket_path()
+{
+    auto runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && *runtime_dir)
+        return std::filesystem::path(runtime_dir) / "molecd.sock";
+    std::error_code ec;
+    auto temporary_dir = std::filesystem::temp_directory_path(ec);
+    if (ec)
+        temporary_dir = "/tmp";
+    return temporary_dir /
+           ("molecd-" + std::to_string(::getuid()) + ".sock");
+}
+
+std::optional<CompileResponse> send_request(
+    const std::filesystem::path &socket_path, const CompileRequest &request)
+{
+    auto connection = connect_to(socket_path);
+    if (connection < 0)
+        return std::nullopt;
+    auto response = std::optional<CompileResponse>();
+    if (send_message(connection, encode_request(request)))
+        response = receive_response(connection);
+    ::close(connection);
+    return response;
+}
+
+// The socket is only accessible to its owner, as the server reads and writes
+// files on behalf of its clients. It's created with these permissions right
+// away, so that no other user can connect to it before they're set.
+CompileServer::CompileServer(const std::filesystem::path &socket_path,
+                             const std::string &version,
+                             const unsigned &threads)
+    : socket_path(socket_path), version(version), socket(-1),
+      is_stopped(false), pool(llvm::hardware_concurrency(threads))
+{
+    auto address = get_address(socket_path);
+    if (!address)
+        throw std::system_error(
+            std::make_error_code(std::errc::filename_too_long),
+            socket_path.string());
+    auto running = connect_to(socket_path);
+    if (running >= 0)
+    {
+        ::close(running);
+        throw std::system_error(
+            std::make_error_code(std::errc::address_in_use),
+            "A server already listens on " + socket_path.string());
+    }
+    // a socket left behind by a server that didn't exit cleanly
+    std::error_code ec;
+    if (std::filesystem::is_socket(socket_path, ec))
+        std::filesystem::remove(socket_path, ec);
+
+    this->socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->socket < 0)
+        throw get_error("Couldn't create a socket");
+    auto previous_mask = ::umask(S_IRWXG | S_IRWXO | S_IXUSR);
+    auto bound =
+        ::bind(this->socket, reinterpret_cast<const sockaddr *>(&*address),
+               sizeof(*address));
+    ::umask(previous_mask);
+    if (bound < 0)
+    {
+        auto error = get_error("Couldn't bind to " + socket_path.string());
+        ::close(this->socket);
+        throw error;
+    }
+    if (::listen(this->socket, SOMAXCONN) < 0)
+    {
+        auto error = get_error("Couldn't listen on " + socket_path.string());
+        ::close(this->socket);
+        std::filesystem::remove(socket_path, ec);
+        throw error;
+    }
+}
+
+CompileServer::~CompileServer()
+{
+    this->pool.wait();
+    ::close(this->socket);
+    std::error_code ec;
+    std::filesystem::remove(this->socket_path, ec);
+}
+
+void CompileServer::serve()
+{
+    while (!this->is_stopped)
+    {
+        auto connection =
+            ::accept4(this->socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection >= 0)
+        {
+            this->pool.async([this, connection] {
+                this->handle(connection);
+                ::close(connection);
+            });
+        }
+        else if (!this->is_stopped && errno != EINTR &&
+                 errno != ECONNABORTED)
+            throw get_error("Couldn't accept a connection");
+    }
+    this->pool.wait();
+}
+
+// Shutting the socket down wakes up the pending `accept` call.
+void CompileServer::stop()
+{
+    this->is_stopped = true;
+    ::shutdown(this->socket, SHUT_RDWR);
+}
+
+void CompileServer::handle(const int &connection)
+{
+    if (!is_peer_trusted(connection))
+        return;
+    auto request = receive_request(connection);
+    if (!request || request->version != this->version)
+        return;
+    auto diagnostics = std::wostringstream();
+    auto status = this->compile(*request, diagnostics);
+    send_message(connection,
+                 encode_response(CompileResponse{status, diagnostics.str()}));
+}
+
+std::unique_ptr<llvm::TargetMachine> CompileServer::acquire_target_machine(
+    const CompilationTarget &target)
+{
+    auto resolved = resolve_target(target);
+    {
+        auto lock = std::lock_guard(this->machines_mutex);
+        auto &pooled = this->machines[get_machine_key(
+            resolved.triple, resolved.cpu, resolved.features)];
+        if (!pooled.empty())
+        {
+            auto result = std::move(pooled.back());
+            pooled.pop_back();
+            return result;
+        }
+    }
+    return create_target_machine(resolved);
+}
+
+void CompileServer::release_target_machine(
+    std::unique_ptr<llvm::TargetMachine> target_machine)
+{
+    auto key = get_machine_key(target_machine->getTargetTriple().str(),
+                               target_machine->getTargetCPU().str(),
+                               target_machine->getTargetFeatureString().str());
+    auto lock = std::lock_guard(this->machines_mutex);
+    this->machines[key].push_back(std::move(target_machine));
+}
+
+int CompileServer::compile(const CompileRequest &request,
+                           std::wostream &diagnostics)
+{
+    auto logger = ConsoleLogger(diagnostics);
+    auto error_checker = ExecutionLogger();
+    if (request.no_warnings)
+        logger.set_min_level(LogLevel::ERROR);
+
+    LexerPtr lexer;
+    try
+    {
+        lexer = Lexer::from_file(request.path);
+    }
+    catch (const std::ios_base::failure &e)
+    {
+        diagnostics << e.what() << '\n';
+        return std::make_error_condition(std::errc::io_error).value();
+    }
+    lexer->add_logger(&logger);
+    lexer->add_logger(&error_checker);
+
+    auto parser = Parser(std::move(lexer));
+    parser.add_logger(&logger);
+    parser.add_logger(&error_checker);
+    auto program = parser.parse();
+    if (!error_checker)
+        return std::make_error_condition(std::errc::invalid_argument).value();
+
+    auto semantic_checker = SemanticChecker();
+    semantic_checker.add_logger(&logger);
+    semantic_checker.add_logger(&error_checker);
+    semantic_checker.check(*program);
+    if (!error_checker)
+        return std::make_error_condition(std::errc::invalid_argument).value();
+    DeadCodeEliminator().eliminate(*program);
+
+    try
+    {
+        auto compiled = CompiledProgram(
+            *program, this->acquire_target_machine(request.target),
+            request.path, request.debug_info);
+        compiled.optimize(request.level);
+        std::error_code ec;
+        auto output = llvm::raw_fd_ostream(request.output_path, ec);
+        if (ec)
+        {
+            diagnostics << "Error while opening the output file." << std::endl;
+            return std::make_error_condition(std::errc::io_error).value();
+        }
+        if (request.kind == OutputKind::IR)
+            compiled.output_ir(output);
+        else if (request.kind == OutputKind::BYTECODE)
+            compiled.output_bytecode(output);
+        else
+            compiled.output_object_file(output, request.threads);
+        this->release_target_machine(compiled.release_target_machine());
+    }
+    catch (const CompilationException &e)
+    {
+        diagnostics << e.what() << '\n';
+        return std::make_error_condition(std::errc::invalid_argument).value();
+    }
+    return 0;
+}
\ No newline at end of file
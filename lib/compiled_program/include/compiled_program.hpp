@@ -1,11 +1,64 @@
 #ifndef __IR_GENERATOR_HPP__
 #define __IR_GENERATOR_HPP__
+#include "compilation_cache.hpp"
+#include "effect_analyzer.hpp"
+#include "range_analyzer.hpp"
 #include "visitor.hpp"
+#include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/Passes/OptimizationLevel.h"
 #include "llvm/Target/TargetMachine.h"
 #include <filesystem>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Machine the generated code is meant for. An empty triple stands for the
+// host's default triple, while the `native` CPU stands for the host's CPU
+// along with all of the features it supports.
+struct CompilationTarget
+{
+    std::string triple = "", cpu = "generic", features = "";
+};
+
+// Initializes only the LLVM target generating code for the given triple, or
+// the host's one if it's empty. Throws a `CompilationException` if there's no
+// such target.
+void initialize_target(const std::string &triple);
+// Replaces the defaults standing for the host with the actual triple, CPU and
+// features of the machine the compiler runs on.
+CompilationTarget resolve_target(const CompilationTarget &target);
+// Throws a `CompilationException` if the target or its CPU are unknown.
+std::unique_ptr<llvm::TargetMachine> create_target_machine(
+    const CompilationTarget &target);
+
+enum class ProfileAction
+{
+    NONE,
+    GENERATE,
+    USE
+};
+
+// Profile-guided optimization. Generating a profile instruments the code to
+// count how often every branch is taken, the counts are written to the raw
+// profile at the path (LLVM's `default.profraw` if it's empty) once the
+// program exits. Such programs have to be linked with LLVM's profile runtime.
+// The raw profiles merged into an indexed one with `llvm-profdata merge` can
+// then be used to guide the optimizations.
+struct ProfileOptions
+{
+    ProfileAction action = ProfileAction::NONE;
+    std::string path = "";
+};
+
+// Size of the generated module, declarations of external functions aside.
+struct ModuleSize
+{
+    std::size_t functions = 0, basic_blocks = 0, instructions = 0;
+};
 
 class CompiledProgram
 {
@@ -39,6 +92,7 @@ class CompiledProgram
         std::unique_ptr<llvm::LLVMContext> context;
         std::unique_ptr<llvm::IRBuilder<>> builder;
         std::unique_ptr<llvm::TargetMachine> target_machine;
+        std::string target_cpu, target_features;
         bool is_signed, is_exhaustive, is_return_covered;
         llvm::Value *matched_value;
         Value last_value;
@@ -49,6 +103,14 @@ class CompiledProgram
         std::vector<std::unordered_map<std::wstring, Value>> variables;
         std::unordered_map<std::wstring, Function> functions;
         std::unordered_map<std::wstring, Value> globals;
+        std::unordered_map<std::wstring, llvm::Constant *> string_literals;
+        EffectMap effects;
+        RangeFacts range_facts;
+        // only created if the debug info is generated
+        std::unique_ptr<llvm::DIBuilder> debug_builder;
+        llvm::DICompileUnit *debug_unit;
+        // the innermost scope is the last one
+        std::vector<llvm::DIScope *> debug_scopes;
 
         void enter_scope();
         void leave_scope();
@@ -59,6 +121,23 @@ class CompiledProgram
         Value find_variable(const std::wstring &name) const;
         Function find_function(const std::wstring &name) const;
 
+        llvm::DIType *get_debug_type(const Type &type);
+        llvm::DIType *get_debug_type(llvm::Type *type);
+        llvm::DISubroutineType *get_debug_fn_type(const FuncDef &node);
+        llvm::DebugLoc set_debug_location(const Position &position);
+        void reset_debug_location(const llvm::DebugLoc &location);
+        void declare_debug_variable(llvm::AllocaInst *address,
+                                    const std::wstring &name,
+                                    const Position &position,
+                                    llvm::DIType *type,
+                                    const unsigned &arg_number = 0);
+
+        llvm::Function *get_integer_power_function(const bool &is_signed);
+        llvm::Value *create_integer_power(llvm::Value *base,
+                                          llvm::Value *exponent,
+                                          const bool &is_signed);
+        llvm::Value *create_double_power(llvm::Value *base,
+                                         llvm::Value *exponent);
         void create_unsigned_binop(llvm::Value *lhs, llvm::Value *rhs,
                                    const BinOpEnum &op);
         void create_signed_binop(llvm::Value *lhs, llvm::Value *rhs,
@@ -68,6 +147,20 @@ class CompiledProgram
         void create_string_binop(llvm::Value *lhs, llvm::Value *rhs,
                                  const BinOpEnum &op);
         llvm::Value *get_dereferenced_value(const Value &value);
+        llvm::Constant *get_string_literal(const std::wstring &value);
+        llvm::AllocaInst *create_entry_alloca(llvm::Type *type);
+        void add_wrap_flags(const AstNode &node, llvm::Value *value);
+        void add_range_metadata(const AstNode &node, llvm::LoadInst *load);
+        void create_logical_binop(llvm::Value *lhs, const Expression &rhs,
+                                  const bool &is_and);
+        std::unique_ptr<llvm::Module> get_optimized_function(
+            const llvm::Function &function,
+            const std::unordered_set<const llvm::GlobalValue *> &symbols,
+            const llvm::OptimizationLevel &level, CompilationCache &cache,
+            const std::vector<std::string> &key_options);
+        void output_split_object_file(llvm::raw_fd_ostream &output,
+                                      const unsigned &threads,
+                                      const std::string &module_id);
         void visit(const BinaryExpr &node);
         void visit(const UnaryExpr &node);
         void visit_call(const CallExpr &node);
@@ -76,7 +169,11 @@ class CompiledProgram
 
       public:
         std::unique_ptr<llvm::Module> module;
-        Visitor(const Program &);
+        std::unordered_set<std::string> compiled_functions;
+        Visitor(const Program &program,
+                std::unique_ptr<llvm::TargetMachine> target_machine,
+                const std::filesystem::path &source_path,
+                const bool &debug_info);
         Visitor(const Visitor &) = delete;
         Visitor(Visitor &&) = default;
 
@@ -89,12 +186,16 @@ class CompiledProgram
 
         void declare_global(const VarDeclStmt &node);
         void visit(const VarDeclStmt &node);
+        void add_effect_attributes(llvm::Function *func,
+                                   const FunctionEffects &effects);
         void declare_func(const FuncDef &node);
         void visit(const FuncDef &node);
         void visit(const ExternDef &node);
 
         llvm::Value *create_literal_condition_value(const Expression &expr);
         void visit(const LiteralArm &node);
+        void visit_switch_arm(const LiteralArm &node,
+                              llvm::SwitchInst *switch_inst);
         void visit(const GuardArm &node);
         void visit(const ElseArm &node);
 
@@ -104,20 +205,79 @@ class CompiledProgram
 
         void visit(const Program &node) override;
 
-        void optimize();
-        void output_object_file(llvm::raw_fd_ostream &output);
+        void optimize(const llvm::OptimizationLevel &level,
+                      llvm::PassInstrumentationCallbacks *callbacks,
+                      const ProfileOptions &profile);
+        void optimize_incrementally(
+            const llvm::OptimizationLevel &level, CompilationCache &cache,
+            const std::vector<std::string> &key_options);
+        void output_object_file(llvm::raw_fd_ostream &output,
+                                const unsigned &threads);
+        int execute(const std::vector<std::string> &args);
+        int execute_lazily(const std::vector<std::string> &args,
+                           const llvm::OptimizationLevel &level,
+                           const unsigned &threads);
+        std::unique_ptr<llvm::TargetMachine> release_target_machine();
     } visitor;
 
   public:
-    CompiledProgram(const Program &);
+    // The path of the program's source becomes the module's source file name,
+    // which the names of the profiled internal functions are prefixed with.
+    // If debug info is asked for, DWARF debug info pointing at the source is
+    // generated along with the code.
+    CompiledProgram(const Program &program,
+                    const CompilationTarget &target = CompilationTarget(),
+                    const std::filesystem::path &source_path = {},
+                    const bool &debug_info = false);
+    // Generates the code with the given target machine, which can be reused
+    // for other programs once released.
+    CompiledProgram(const Program &program,
+                    std::unique_ptr<llvm::TargetMachine> target_machine,
+                    const std::filesystem::path &source_path = {},
+                    const bool &debug_info = false);
     CompiledProgram(const CompiledProgram &) = delete;
     CompiledProgram(CompiledProgram &&) = default;
 
-    void output_ir(llvm::raw_fd_ostream &output);
+    void output_ir(llvm::raw_ostream &output);
     void output_bytecode(llvm::raw_fd_ostream &output);
-    void output_object_file(llvm::raw_fd_ostream &output);
-    void optimize();
-    // int execute();
+    // With more than one thread, the machine code is generated for parts of
+    // the module concurrently and the parts are merged with `ld -r`.
+    void output_object_file(llvm::raw_fd_ostream &output,
+                            const unsigned &threads = 1);
+    // The callbacks, if given, are called around every pass that's run. If
+    // the time trace is enabled, the passes are added to it as well. Throws a
+    // `CompilationException` if the used profile isn't an indexed one
+    // generated by instrumenting the IR.
+    void optimize(const llvm::OptimizationLevel &level,
+                  llvm::PassInstrumentationCallbacks *callbacks = nullptr,
+                  const ProfileOptions &profile = ProfileOptions());
+    // Like `optimize`, but every function is optimized on its own and the
+    // result is cached, so that only the functions whose code changed since
+    // the last compilation are optimized again. As the functions don't see
+    // each other's bodies, nothing gets inlined across them. The key options
+    // should contain everything besides the code that affects the result,
+    // such as the compiler's version and the target.
+    void optimize_incrementally(const llvm::OptimizationLevel &level,
+                                CompilationCache &cache,
+                                const std::vector<std::string> &key_options);
+    // Runs the program's `main` function in-process and returns its result,
+    // or 0 if it doesn't return anything. The arguments are passed to `main`
+    // like C's `argv`, so the first one should be the program's name.
+    int execute(const std::vector<std::string> &args);
+    // Like `execute`, but the functions are optimized at the given level and
+    // compiled only once they're first called, which makes the program start
+    // faster when it uses only a part of its code. The program shouldn't be
+    // optimized beforehand. With compile threads, the callees of compiled
+    // functions are compiled in the background ahead of their first call.
+    int execute_lazily(const std::vector<std::string> &args,
+                       const llvm::OptimizationLevel &level,
+                       const unsigned &threads);
+    // Names of the functions compiled by the last lazy execution, including
+    // the ones compiled in the background that were never called.
+    const std::unordered_set<std::string> &get_compiled_functions() const;
+    ModuleSize get_size() const;
+    // Takes the target machine back, after which nothing can be output.
+    std::unique_ptr<llvm::TargetMachine> release_target_machine();
 };
 
 class CompilationException : std::runtime_error
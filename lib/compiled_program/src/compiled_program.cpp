@@ -1,40 +1,595 @@
 #include "compiled_program.hpp"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/MCSubtargetInfo.h"
 #include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ModRef.h"
+#include "llvm/Support/PGOOptions.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/TargetParser/Host.h"
-#include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
 #include <ranges>
+#include <unordered_set>
 
-CompiledProgram::Visitor::Visitor(const Program &program)
-    : context(std::make_unique<llvm::LLVMContext>())
+namespace
 {
+llvm::CodeGenOpt::Level get_codegen_level(
+    const llvm::OptimizationLevel &level)
+{
+    switch (level.getSpeedupLevel())
+    {
+    case 0:
+        return llvm::CodeGenOpt::None;
+    case 1:
+        return llvm::CodeGenOpt::Less;
+    case 2:
+        return llvm::CodeGenOpt::Default;
+    default:
+        return llvm::CodeGenOpt::Aggressive;
+    }
+}
+
+std::string get_ir_name(const llvm::Any &ir)
+{
+    if (auto function = llvm::any_cast<const llvm::Function *>(&ir))
+        return (*function)->getName().str();
+    if (auto module = llvm::any_cast<const llvm::Module *>(&ir))
+        return (*module)->getName().str();
+    return "";
+}
+
+// The new pass manager only adds the passes to the time trace if they're
+// instrumented. Nothing is captured, so the callbacks can outlive the
+// pipeline.
+void register_time_trace_callbacks(
+    llvm::PassInstrumentationCallbacks &callbacks)
+{
+    callbacks.registerBeforeNonSkippedPassCallback(
+        [](llvm::StringRef pass, llvm::Any ir) {
+            llvm::timeTraceProfilerBegin(pass, get_ir_name(ir));
+        });
+    callbacks.registerAfterPassCallback(
+        [](llvm::StringRef, llvm::Any, const llvm::PreservedAnalyses &) {
+            llvm::timeTraceProfilerEnd();
+        });
+    callbacks.registerAfterPassInvalidatedCallback(
+        [](llvm::StringRef, const llvm::PreservedAnalyses &) {
+            llvm::timeTraceProfilerEnd();
+        });
+}
+
+std::optional<llvm::PGOOptions> get_pgo_options(const ProfileOptions &profile)
+{
+    switch (profile.action)
+    {
+    case ProfileAction::GENERATE:
+        return llvm::PGOOptions(profile.path, "", "", "", nullptr,
+                                llvm::PGOOptions::IRInstr);
+    case ProfileAction::USE:
+        return llvm::PGOOptions(profile.path, "", "", "",
+                                llvm::vfs::getRealFileSystem(),
+                                llvm::PGOOptions::IRUse);
+    default:
+        return std::nullopt;
+    }
+}
+
+// LLVM would report an unreadable profile by exiting, so it's checked
+// beforehand.
+void check_profile(const ProfileOptions &profile)
+{
+    if (profile.action != ProfileAction::USE)
+        return;
+    auto buffer = llvm::MemoryBuffer::getFile(profile.path);
+    if (!buffer)
+        throw CompilationException("The profile \"" + profile.path +
+                                   "\" couldn't be read: " +
+                                   buffer.getError().message());
+    if (!llvm::IndexedInstrProfReader::hasFormat(**buffer))
+        throw CompilationException(
+            "The profile \"" + profile.path +
+            "\" isn't an indexed one, raw profiles have to be merged with "
+            "`llvm-profdata merge` first.");
+    auto reader = llvm::IndexedInstrProfReader::create(std::move(*buffer));
+    if (!reader)
+        throw CompilationException("The profile \"" + profile.path +
+                                   "\" couldn't be read: " +
+                                   llvm::toString(reader.takeError()));
+    if (!(*reader)->isIRLevelProfile())
+        throw CompilationException(
+            "The profile \"" + profile.path +
+            "\" wasn't generated with -fprofile-generate, front-end "
+            "profiles can't be used.");
+}
 
+// The size levels only tune the pipeline, the functions themselves have to
+// ask the passes and the backend to favour smaller code.
+void run_pipeline(llvm::Module &module, llvm::TargetMachine *target_machine,
+                  const llvm::OptimizationLevel &level,
+                  llvm::PassInstrumentationCallbacks *callbacks = nullptr,
+                  const ProfileOptions &profile = ProfileOptions())
+{
+    auto trace_callbacks = llvm::PassInstrumentationCallbacks();
+    if (llvm::timeTraceProfilerEnabled())
+    {
+        if (!callbacks)
+            callbacks = &trace_callbacks;
+        register_time_trace_callbacks(*callbacks);
+    }
+    llvm::LoopAnalysisManager loop_manager;
+    llvm::FunctionAnalysisManager function_manager;
+    llvm::CGSCCAnalysisManager cgscc_manager;
+    llvm::ModuleAnalysisManager module_manager;
+    llvm::PassBuilder pass_builder(target_machine,
+                                   llvm::PipelineTuningOptions(),
+                                   get_pgo_options(profile), callbacks);
+    pass_builder.registerModuleAnalyses(module_manager);
+    pass_builder.registerCGSCCAnalyses(cgscc_manager);
+    pass_builder.registerFunctionAnalyses(function_manager);
+    pass_builder.registerLoopAnalyses(loop_manager);
+    pass_builder.crossRegisterProxies(loop_manager, function_manager,
+                                      cgscc_manager, module_manager);
+
+    for (auto &function : module)
+    {
+        if (function.isDeclaration())
+            continue;
+        if (level.getSizeLevel() > 0)
+            function.addFnAttr(llvm::Attribute::OptimizeForSize);
+        if (level.getSizeLevel() > 1)
+            function.addFnAttr(llvm::Attribute::MinSize);
+    }
+
+    auto pass_manager =
+        (level == llvm::OptimizationLevel::O0)
+            ? (pass_builder.buildO0DefaultPipeline(level))
+            : (pass_builder.buildPerModuleDefaultPipeline(level));
+    pass_manager.run(module, module_manager);
+}
+
+bool extend_addition_chain(std::vector<std::uint32_t> &chain,
+                           const std::uint32_t &target,
+                           const std::size_t &max_length)
+{
+    auto last = chain.back();
+    if (last == target)
+        return true;
+    if (chain.size() == max_length)
+        return false;
+    // even doubling at every remaining step can't reach the target
+    if ((std::uint64_t(last) << (max_length - chain.size())) < target)
+        return false;
+    for (auto i = chain.size(); i-- > 0;)
+    {
+        auto next = std::uint64_t(last) + chain[i];
+        if (next > target)
+            continue;
+        chain.push_back(next);
+        if (extend_addition_chain(chain, target, max_length))
+            return true;
+        chain.pop_back();
+    }
+    return false;
+}
+
+// Returns an addition chain starting with 1 and ending with the exponent, or
+// an empty one for the zero exponent. Small exponents get the shortest star
+// chain, found with an iterative deepening search; star chains are optimal
+// for all of them. Larger ones fall back to the binary method.
+std::vector<std::uint32_t> get_addition_chain(const std::uint32_t &exponent)
+{
+    constexpr std::uint32_t max_searched_exponent = 256;
+    if (exponent == 0)
+        return {};
+    std::vector<std::uint32_t> chain;
+    if (exponent <= max_searched_exponent)
+    {
+        for (std::size_t length = 1;; ++length)
+        {
+            chain.assign(1, 1);
+            if (extend_addition_chain(chain, exponent, length))
+                return chain;
+        }
+    }
+    chain.assign(1, 1);
+    for (auto bit = std::bit_width(exponent) - 1; bit-- > 0;)
+    {
+        chain.push_back(chain.back() * 2);
+        if (exponent & (1u << bit))
+            chain.push_back(chain.back() + 1);
+    }
+    return chain;
+}
+
+template <typename T> T get_or_throw(llvm::Expected<T> value)
+{
+    if (!value)
+        throw CompilationException(llvm::toString(value.takeError()));
+    return std::move(*value);
+}
+
+void throw_if_error(llvm::Error error)
+{
+    if (error)
+        throw CompilationException(llvm::toString(std::move(error)));
+}
+
+bool emit_object_file(llvm::Module &module,
+                      llvm::TargetMachine &target_machine,
+                      llvm::raw_pwrite_stream &output)
+{
+    llvm::legacy::PassManager pass_manager;
+    auto type = llvm::CodeGenFileType::CGFT_ObjectFile;
+    if (target_machine.addPassesToEmitFile(pass_manager, output, nullptr,
+                                           type))
+        return false;
+    pass_manager.run(module);
+    return true;
+}
+
+// Runs on a worker thread, so errors are returned as messages instead of
+// being thrown. The target machine is only used as a template for a new one,
+// as they can't be shared between threads.
+std::string emit_partition(const llvm::SmallString<0> &bitcode,
+                           const std::string &path,
+                           const llvm::TargetMachine &target_machine)
+{
+    llvm::LLVMContext context;
+    auto module = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(bitcode, "partition"), context);
+    if (!module)
+        return llvm::toString(module.takeError());
+    std::unique_ptr<llvm::TargetMachine> partition_machine(
+        target_machine.getTarget().createTargetMachine(
+            target_machine.getTargetTriple().str(),
+            target_machine.getTargetCPU(),
+            target_machine.getTargetFeatureString(), target_machine.Options,
+            target_machine.getRelocationModel(),
+            target_machine.getCodeModel(), target_machine.getOptLevel()));
+    std::error_code ec;
+    auto output = llvm::raw_fd_ostream(path, ec);
+    if (ec)
+        return ec.message();
+    if (!emit_object_file(**module, *partition_machine, output))
+        return "The object file couldn't be emitted.";
+    return "";
+}
+
+// Returns whether the module's `main` returns a value, which decides how it
+// has to be called.
+bool check_executable(const llvm::Module *module)
+{
+    if (!module)
+        throw CompilationException("The program was already executed.");
+    auto main = module->getFunction("main");
+    if (!main || main->isDeclaration())
+        throw CompilationException("The program has no main function.");
+    return !main->getReturnType()->isVoidTy();
+}
+
+llvm::orc::JITTargetMachineBuilder get_jit_machine_builder(
+    const llvm::Module &module, const std::string &cpu,
+    const std::string &features, const llvm::CodeGenOpt::Level &level)
+{
+    auto machine_builder = llvm::orc::JITTargetMachineBuilder(
+        llvm::Triple(module.getTargetTriple()));
+    machine_builder.setCPU(cpu);
+    llvm::SmallVector<llvm::StringRef> split_features;
+    llvm::StringRef(features).split(split_features, ',', -1, false);
+    machine_builder.addFeatures(std::vector<std::string>(
+        split_features.begin(), split_features.end()));
+    machine_builder.setCodeGenOptLevel(level);
+    return machine_builder;
+}
+
+// Externs are resolved against the symbols of the compiler's own process,
+// which includes the C library.
+void add_process_symbols(llvm::orc::LLJIT &jit)
+{
+    auto generator = get_or_throw(
+        llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            jit.getDataLayout().getGlobalPrefix()));
+    jit.getMainJITDylib().addGenerator(std::move(generator));
+}
+
+int run_main(llvm::orc::LLJIT &jit, const bool &returns_value,
+             const std::vector<std::string> &args)
+{
+    auto address = get_or_throw(jit.lookup("main"));
+    if (!returns_value)
+    {
+        address.toPtr<void (*)()>()();
+        return 0;
+    }
+    return llvm::orc::runAsMain(address.toPtr<int (*)(int, char *[])>(),
+                                args);
+}
+
+// Starts compiling the bodies of the functions called by a freshly compiled
+// function in the background, so that they are usually ready by the time
+// they get called. The lazy JIT keeps the bodies in a separate `.impl`
+// dylib, looking them up in the main one would only resolve their stubs.
+void compile_callees(llvm::orc::LLLazyJIT &jit, const llvm::Module &module,
+                     const std::unordered_set<std::string> &defined)
+{
+    auto &session = jit.getExecutionSession();
+    auto impl = session.getJITDylibByName(jit.getMainJITDylib().getName() +
+                                          ".impl");
+    if (!impl)
+        return;
+    auto callees = llvm::orc::SymbolLookupSet();
+    for (const auto &function : module)
+    {
+        auto name = function.getName();
+        if (function.isDeclaration() && defined.contains(name.str()))
+            callees.add(jit.mangleAndIntern(name));
+    }
+    if (callees.empty())
+        return;
+    session.lookup(
+        llvm::orc::LookupKind::Static,
+        {{impl, llvm::orc::JITDylibLookupFlags::MatchAllSymbols}},
+        std::move(callees), llvm::orc::SymbolState::Ready,
+        [](llvm::Expected<llvm::orc::SymbolMap> result) {
+            llvm::consumeError(result.takeError());
+        },
+        llvm::orc::NoDependenciesToRegister);
+}
+
+// Clones the function into a module of its own, where everything else it
+// uses is only declared. Local helpers such as string literals can't be
+// declared, so every module gets copies of the ones it uses, while the
+// program's own globals and functions stay shared. The local helpers are
+// left unnamed, so that the literals of other functions don't change their
+// numbering.
+std::unique_ptr<llvm::Module> extract_function(
+    const llvm::Module &module, const llvm::Function &function,
+    const std::unordered_set<const llvm::GlobalValue *> &symbols)
+{
+    llvm::ValueToValueMapTy map;
+    auto result = llvm::CloneModule(
+        module, map, [&](const llvm::GlobalValue *value) {
+            return value == &function ||
+                   (value->hasLocalLinkage() && !symbols.contains(value));
+        });
+    auto cloned = llvm::cast<llvm::Function>(map[&function]);
+    cloned->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    for (auto &other : llvm::make_early_inc_range(result->functions()))
+    {
+        if (&other != cloned && other.use_empty())
+            other.eraseFromParent();
+    }
+    for (auto &global : llvm::make_early_inc_range(result->globals()))
+    {
+        if (global.use_empty())
+            global.eraseFromParent();
+        else if (global.hasLocalLinkage())
+            global.setName("");
+    }
+    return result;
+}
+
+// Integer literals (possibly negated) are folded into constants by the IR
+// builder, so they can be used as the case values of a switch.
+bool is_constant_literal(const Expression &expr)
+{
+    if (std::holds_alternative<U32Expr>(expr) ||
+        std::holds_alternative<CharExpr>(expr) ||
+        std::holds_alternative<BoolExpr>(expr))
+        return true;
+    if (auto unary = std::get_if<UnaryExpr>(&expr))
+        return (unary->op == UnaryOpEnum::MINUS ||
+                unary->op == UnaryOpEnum::BIT_NEG ||
+                unary->op == UnaryOpEnum::NEG) &&
+               is_constant_literal(*unary->expr);
+    return false;
+}
+
+// Expressions that can be evaluated even when their value isn't needed, as
+// they can neither fault nor have side effects. The depth limits the work
+// that may be wasted.
+bool is_speculatable(const Expression &expr, const std::size_t &depth)
+{
+    auto is_leaf = std::holds_alternative<VariableExpr>(expr) ||
+                   std::holds_alternative<U32Expr>(expr) ||
+                   std::holds_alternative<F64Expr>(expr) ||
+                   std::holds_alternative<CharExpr>(expr) ||
+                   std::holds_alternative<BoolExpr>(expr);
+    if (is_leaf)
+        return true;
+    if (depth == 0)
+        return false;
+    if (auto unary = std::get_if<UnaryExpr>(&expr))
+        return unary->op != UnaryOpEnum::DEREF &&
+               is_speculatable(*unary->expr, depth - 1);
+    if (auto binary = std::get_if<BinaryExpr>(&expr))
+        return binary->op != BinOpEnum::DIV && binary->op != BinOpEnum::MOD &&
+               binary->op != BinOpEnum::EXP &&
+               is_speculatable(*binary->lhs, depth - 1) &&
+               is_speculatable(*binary->rhs, depth - 1);
+    if (auto cast = std::get_if<CastExpr>(&expr))
+        return is_speculatable(*cast->expr, depth - 1);
+    return false;
+}
+
+// Only the leading literal arms can be dispatched at once, as the arms after
+// a guard must not be tested before the guard's condition is evaluated.
+std::size_t count_switch_arms(const MatchStmt &node)
+{
+    std::size_t result = 0;
+    for (const auto &arm : node.match_arms)
+    {
+        auto literal_arm = std::get_if<LiteralArm>(arm.get());
+        if (!literal_arm ||
+            !std::ranges::all_of(literal_arm->literals,
+                                 [](const auto &literal) {
+                                     return is_constant_literal(*literal);
+                                 }))
+            break;
+        ++result;
+    }
+    return result;
+}
+} // namespace
+
+// The target infos only register the targets' names, so initializing all of
+// them is cheap, unlike the code generators.
+void initialize_target(const std::string &triple)
+{
+    if (triple.empty())
+    {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmParser();
+        llvm::InitializeNativeTargetAsmPrinter();
+        return;
+    }
+    llvm::InitializeAllTargetInfos();
     std::string logs;
+    auto llvm_target = llvm::TargetRegistry::lookupTarget(triple, logs);
+    if (!llvm_target)
+        throw CompilationException(logs);
+    auto name = std::string_view(llvm_target->getBackendName());
+#define LLVM_TARGET(TargetName)                                               \
+    if (name == #TargetName)                                                  \
+    {                                                                         \
+        LLVMInitialize##TargetName##Target();                                 \
+        LLVMInitialize##TargetName##TargetMC();                               \
+    }
+#include "llvm/Config/Targets.def"
+#define LLVM_ASM_PARSER(TargetName)                                           \
+    if (name == #TargetName)                                                  \
+        LLVMInitialize##TargetName##AsmParser();
+#include "llvm/Config/AsmParsers.def"
+#define LLVM_ASM_PRINTER(TargetName)                                          \
+    if (name == #TargetName)                                                  \
+        LLVMInitialize##TargetName##AsmPrinter();
+#include "llvm/Config/AsmPrinters.def"
+}
 
-    auto target_triple = llvm::sys::getDefaultTargetTriple();
-    auto target = llvm::TargetRegistry::lookupTarget(target_triple, logs);
-    if (!target)
+// Features given explicitly are appended after the host's ones, so that they
+// take precedence over them.
+CompilationTarget resolve_target(const CompilationTarget &target)
+{
+    auto result = target;
+    result.triple = (target.triple.empty())
+                        ? (llvm::sys::getDefaultTargetTriple())
+                        : (llvm::Triple::normalize(target.triple));
+    if (target.cpu != "native")
+        return result;
+    result.cpu = llvm::sys::getHostCPUName().str();
+    result.features = "";
+    llvm::StringMap<bool> host_features;
+    if (llvm::sys::getHostCPUFeatures(host_features))
+    {
+        for (const auto &feature : host_features)
+        {
+            if (!result.features.empty())
+                result.features += ",";
+            result.features += (feature.getValue()) ? ("+") : ("-");
+            result.features += feature.getKey().str();
+        }
+    }
+    if (!target.features.empty())
+    {
+        if (!result.features.empty())
+            result.features += ",";
+        result.features += target.features;
+    }
+    return result;
+}
+
+std::unique_ptr<llvm::TargetMachine> create_target_machine(
+    const CompilationTarget &target)
+{
+    std::string logs;
+
+    auto resolved = resolve_target(target);
+    auto llvm_target =
+        llvm::TargetRegistry::lookupTarget(resolved.triple, logs);
+    if (!llvm_target)
         throw CompilationException(logs.c_str());
+    std::unique_ptr<llvm::MCSubtargetInfo> subtarget_info(
+        llvm_target->createMCSubtargetInfo(resolved.triple, resolved.cpu,
+                                           resolved.features));
+    if (!subtarget_info || !subtarget_info->isCPUStringValid(resolved.cpu))
+    {
+        throw CompilationException("Unknown CPU \"" + resolved.cpu +
+                                   "\" for the target \"" + resolved.triple +
+                                   "\".");
+    }
     llvm::TargetOptions target_options;
-    std::unique_ptr<llvm::TargetMachine> target_machine(
-        target->createTargetMachine(target_triple, "generic", "",
-                                    target_options, llvm::Reloc::PIC_));
-    this->target_machine = std::move(target_machine);
+    return std::unique_ptr<llvm::TargetMachine>(
+        llvm_target->createTargetMachine(resolved.triple, resolved.cpu,
+                                         resolved.features, target_options,
+                                         llvm::Reloc::PIC_));
+}
+
+// Debug info is only generated when it's asked for and there's a source for
+// it to point at, the other compilations don't pay anything for it.
+CompiledProgram::Visitor::Visitor(
+    const Program &program,
+    std::unique_ptr<llvm::TargetMachine> target_machine,
+    const std::filesystem::path &source_path, const bool &debug_info)
+    : context(std::make_unique<llvm::LLVMContext>()),
+      target_machine(std::move(target_machine)), is_signed(false),
+      debug_unit(nullptr)
+{
+    std::string logs;
+
+    this->target_cpu = this->target_machine->getTargetCPU().str();
+    this->target_features =
+        this->target_machine->getTargetFeatureString().str();
+    auto target_triple = this->target_machine->getTargetTriple().str();
     auto data_layout = this->target_machine->createDataLayout();
 
     this->module = std::make_unique<llvm::Module>("mole", *this->context);
     this->module->setTargetTriple(target_triple);
     this->module->setDataLayout(data_layout);
+    if (!source_path.empty())
+        this->module->setSourceFileName(source_path.string());
 
     this->builder = std::make_unique<llvm::IRBuilder<>>(*this->context);
+    if (debug_info && !source_path.empty())
+    {
+        this->debug_builder = std::make_unique<llvm::DIBuilder>(*this->module);
+        auto file = this->debug_builder->createFile(
+            source_path.filename().string(),
+            source_path.parent_path().string());
+        // there's no DWARF language code for Mole, C is the closest one
+        this->debug_unit = this->debug_builder->createCompileUnit(
+            llvm::dwarf::DW_LANG_C, file, "molec", false, "", 0);
+        this->module->addModuleFlag(llvm::Module::Warning,
+                                    "Debug Info Version",
+                                    llvm::DEBUG_METADATA_VERSION);
+    }
     this->visit(program);
+    if (this->debug_builder)
+        this->debug_builder->finalize();
 
     auto out = llvm::raw_string_ostream(logs);
 
@@ -44,7 +599,19 @@ CompiledProgram::Visitor::Visitor(const Program &program)
     }
 }
 
-CompiledProgram::CompiledProgram(const Program &program) : visitor(program)
+CompiledProgram::CompiledProgram(const Program &program,
+                                 const CompilationTarget &target,
+                                 const std::filesystem::path &source_path,
+                                 const bool &debug_info)
+    : visitor(program, create_target_machine(target), source_path, debug_info)
+{
+}
+
+CompiledProgram::CompiledProgram(
+    const Program &program,
+    std::unique_ptr<llvm::TargetMachine> target_machine,
+    const std::filesystem::path &source_path, const bool &debug_info)
+    : visitor(program, std::move(target_machine), source_path, debug_info)
 {
 }
 
@@ -143,6 +710,216 @@ CompiledProgram::Visitor::Value CompiledProgram::Visitor::find_variable(
     return this->globals.find(name)->second;
 }
 
+// Refs are pointers to their base types, strings are pointers to chars.
+llvm::DIType *CompiledProgram::Visitor::get_debug_type(const Type &type)
+{
+    llvm::DIType *result;
+    switch (type.type)
+    {
+    case TypeEnum::BOOL:
+        result = this->debug_builder->createBasicType(
+            "bool", 8, llvm::dwarf::DW_ATE_boolean);
+        break;
+    case TypeEnum::I32:
+        result = this->debug_builder->createBasicType(
+            "i32", 32, llvm::dwarf::DW_ATE_signed);
+        break;
+    case TypeEnum::U32:
+        result = this->debug_builder->createBasicType(
+            "u32", 32, llvm::dwarf::DW_ATE_unsigned);
+        break;
+    case TypeEnum::F64:
+        result = this->debug_builder->createBasicType(
+            "f64", 64, llvm::dwarf::DW_ATE_float);
+        break;
+    case TypeEnum::CHAR:
+    case TypeEnum::STR:
+        result = this->debug_builder->createBasicType(
+            "char", 32, llvm::dwarf::DW_ATE_UTF);
+        break;
+    default:
+        std::unreachable();
+    }
+    if (type.ref_spec == RefSpecifier::NON_REF)
+        return result;
+    return this->debug_builder->createPointerType(
+        result, this->module->getDataLayout().getPointerSizeInBits());
+}
+
+// Variables declared without a type only have the type of their value, which
+// doesn't tell what the pointers point at.
+llvm::DIType *CompiledProgram::Visitor::get_debug_type(llvm::Type *type)
+{
+    if (type->isPointerTy())
+        return this->debug_builder->createPointerType(
+            nullptr, this->module->getDataLayout().getPointerSizeInBits());
+    auto mole_type = TypeEnum::U32;
+    if (type->isIntegerTy(1))
+        mole_type = TypeEnum::BOOL;
+    else if (type->isDoubleTy())
+        mole_type = TypeEnum::F64;
+    else if (this->is_signed)
+        mole_type = TypeEnum::I32;
+    return this->get_debug_type(Type(mole_type, RefSpecifier::NON_REF));
+}
+
+llvm::DISubroutineType *CompiledProgram::Visitor::get_debug_fn_type(
+    const FuncDef &node)
+{
+    // the first type is the return type, with null standing for none
+    std::vector<llvm::Metadata *> types{
+        (node.return_type) ? (this->get_debug_type(*node.return_type))
+                           : (nullptr)};
+    for (const auto &param : node.params)
+        types.push_back(this->get_debug_type(param->type));
+    return this->debug_builder->createSubroutineType(
+        this->debug_builder->getOrCreateTypeArray(types));
+}
+
+// Returns the previous location, which should be reset once the node's code
+// is generated. Code outside of functions doesn't get any.
+llvm::DebugLoc CompiledProgram::Visitor::set_debug_location(
+    const Position &position)
+{
+    if (!this->debug_builder || this->debug_scopes.empty())
+        return llvm::DebugLoc();
+    auto previous = this->builder->getCurrentDebugLocation();
+    this->builder->SetCurrentDebugLocation(
+        llvm::DILocation::get(*this->context, position.line, position.column,
+                              this->debug_scopes.back()));
+    return previous;
+}
+
+void CompiledProgram::Visitor::reset_debug_location(
+    const llvm::DebugLoc &location)
+{
+    if (this->debug_builder)
+        this->builder->SetCurrentDebugLocation(location);
+}
+
+// Parameters are numbered from 1, the other variables get 0.
+void CompiledProgram::Visitor::declare_debug_variable(
+    llvm::AllocaInst *address, const std::wstring &name,
+    const Position &position, llvm::DIType *type,
+    const unsigned &arg_number)
+{
+    auto scope = this->debug_scopes.back();
+    auto file = this->debug_unit->getFile();
+    auto converted_name = std::string(name.cbegin(), name.cend());
+    auto variable =
+        (arg_number > 0)
+            ? (this->debug_builder->createParameterVariable(
+                  scope, converted_name, arg_number, file, position.line, type,
+                  true))
+            : (this->debug_builder->createAutoVariable(
+                  scope, converted_name, file, position.line, type, true));
+    this->debug_builder->insertDeclare(
+        address, variable, this->debug_builder->createExpression(),
+        llvm::DILocation::get(*this->context, position.line, position.column,
+                              scope),
+        this->builder->GetInsertBlock());
+}
+
+// Wrapping multiplication gives the same bits in both interpretations, so
+// the two helpers only differ in their names.
+llvm::Function *CompiledProgram::Visitor::get_integer_power_function(
+    const bool &is_signed)
+{
+    auto name = (is_signed) ? ("__mole_ipow_i32") : ("__mole_ipow_u32");
+    if (auto func = this->module->getFunction(name))
+        return func;
+
+    auto int_type = llvm::Type::getInt32Ty(*this->context);
+    auto type = llvm::FunctionType::get(int_type, {int_type, int_type}, false);
+    auto func = llvm::Function::Create(type, llvm::Function::InternalLinkage,
+                                       name, *this->module);
+    func->addFnAttr(llvm::Attribute::AlwaysInline);
+    func->addFnAttr(llvm::Attribute::NoUnwind);
+    func->addFnAttr(llvm::Attribute::WillReturn);
+    func->setDoesNotAccessMemory();
+
+    // exponentiation by squaring
+    auto entry = llvm::BasicBlock::Create(*this->context, "entry", func);
+    auto loop = llvm::BasicBlock::Create(*this->context, "loop", func);
+    auto body = llvm::BasicBlock::Create(*this->context, "body", func);
+    auto exit = llvm::BasicBlock::Create(*this->context, "exit", func);
+    auto builder = llvm::IRBuilder<>(entry);
+    builder.CreateBr(loop);
+
+    builder.SetInsertPoint(loop);
+    auto result = builder.CreatePHI(int_type, 2, "result");
+    auto base = builder.CreatePHI(int_type, 2, "base");
+    auto exponent = builder.CreatePHI(int_type, 2, "exponent");
+    builder.CreateCondBr(builder.CreateICmpEQ(exponent, builder.getInt32(0)),
+                         exit, body);
+
+    builder.SetInsertPoint(body);
+    auto is_odd = builder.CreateTrunc(exponent, builder.getInt1Ty());
+    auto next_result = builder.CreateSelect(
+        is_odd, builder.CreateMul(result, base), result);
+    auto next_base = builder.CreateMul(base, base);
+    auto next_exponent = builder.CreateLShr(exponent, 1);
+    builder.CreateBr(loop);
+
+    result->addIncoming(builder.getInt32(1), entry);
+    result->addIncoming(next_result, body);
+    base->addIncoming(func->getArg(0), entry);
+    base->addIncoming(next_base, body);
+    exponent->addIncoming(func->getArg(1), entry);
+    exponent->addIncoming(next_exponent, body);
+
+    builder.SetInsertPoint(exit);
+    builder.CreateRet(result);
+    return func;
+}
+
+// Constant exponents are expanded into the shortest chain of multiplications,
+// the other ones are handled by a helper function.
+llvm::Value *CompiledProgram::Visitor::create_integer_power(
+    llvm::Value *base, llvm::Value *exponent, const bool &is_signed)
+{
+    auto constant = llvm::dyn_cast<llvm::ConstantInt>(exponent);
+    if (!constant)
+        return this->builder->CreateCall(
+            this->get_integer_power_function(is_signed), {base, exponent},
+            "exp_i32");
+
+    auto chain = get_addition_chain(constant->getZExtValue());
+    if (chain.empty())
+        return this->builder->getInt32(1);
+    std::vector<llvm::Value *> powers{base};
+    for (std::size_t i = 1; i < chain.size(); ++i)
+    {
+        // every element is the sum of the previous one and any other one
+        auto addend = std::ranges::find(chain, chain[i] - chain[i - 1]);
+        auto addend_power = powers[addend - chain.begin()];
+        powers.push_back(
+            this->builder->CreateMul(powers.back(), addend_power, "exp_i32"));
+    }
+    return powers.back();
+}
+
+// `powi` takes a signed exponent, so exponents that may not fit in it are
+// halved, and the base is multiplied back in for odd ones.
+llvm::Value *CompiledProgram::Visitor::create_double_power(
+    llvm::Value *base, llvm::Value *exponent)
+{
+    auto powi = llvm::Intrinsic::getDeclaration(
+        this->module.get(), llvm::Intrinsic::powi,
+        {base->getType(), exponent->getType()});
+    auto constant = llvm::dyn_cast<llvm::ConstantInt>(exponent);
+    if (constant && !constant->isNegative())
+        return this->builder->CreateCall(powi, {base, exponent}, "exp_f64");
+
+    auto half = this->builder->CreateCall(
+        powi, {base, this->builder->CreateLShr(exponent, 1)}, "exp_f64");
+    auto square = this->builder->CreateFMul(half, half, "exp_f64");
+    auto is_odd =
+        this->builder->CreateTrunc(exponent, this->builder->getInt1Ty());
+    return this->builder->CreateSelect(
+        is_odd, this->builder->CreateFMul(square, base, "exp_f64"), square);
+}
+
 void CompiledProgram::Visitor::create_unsigned_binop(llvm::Value *lhs,
                                                      llvm::Value *rhs,
                                                      const BinOpEnum &op)
@@ -167,10 +944,7 @@ void CompiledProgram::Visitor::create_unsigned_binop(llvm::Value *lhs,
         new_value = this->builder->CreateURem(lhs, rhs, "mod_u32");
         break;
     case BinOpEnum::EXP:
-        new_value = this->builder->CreateCall(
-            llvm::Intrinsic::getDeclaration(this->module.get(),
-                                            llvm::Intrinsic::powi),
-            {lhs, rhs});
+        new_value = this->create_integer_power(lhs, rhs, false);
         break;
     case BinOpEnum::EQ:
         new_value = this->builder->CreateICmpEQ(lhs, rhs, "eq_u32");
@@ -251,10 +1025,7 @@ void CompiledProgram::Visitor::create_signed_binop(llvm::Value *lhs,
         new_value = this->builder->CreateSRem(lhs, rhs, "mod_i32");
         break;
     case BinOpEnum::EXP:
-        new_value = this->builder->CreateCall(
-            llvm::Intrinsic::getDeclaration(this->module.get(),
-                                            llvm::Intrinsic::powi),
-            {lhs, rhs});
+        new_value = this->create_integer_power(lhs, rhs, true);
         break;
     case BinOpEnum::EQ:
         new_value = this->builder->CreateICmpEQ(lhs, rhs, "eq_i32");
@@ -326,10 +1097,7 @@ void CompiledProgram::Visitor::create_double_binop(llvm::Value *lhs,
         new_value = this->builder->CreateFRem(lhs, rhs, "mod_f64");
         break;
     case BinOpEnum::EXP:
-        new_value = this->builder->CreateCall(
-            llvm::Intrinsic::getDeclaration(this->module.get(),
-                                            llvm::Intrinsic::pow),
-            {lhs, rhs});
+        new_value = this->create_double_power(lhs, rhs);
         break;
     case BinOpEnum::EQ:
         new_value = this->builder->CreateFCmpOEQ(lhs, rhs, "eq_f64");
@@ -375,12 +1143,51 @@ llvm::Value *CompiledProgram::Visitor::get_dereferenced_value(
         return value.value;
 }
 
+// Marks an arithmetic instruction as non-wrapping where the range analysis
+// has proven it. Constant folded values are left as they are.
+void CompiledProgram::Visitor::add_wrap_flags(const AstNode &node,
+                                              llvm::Value *value)
+{
+    auto found = this->range_facts.wrap_flags.find(&node);
+    auto inst = llvm::dyn_cast<llvm::Instruction>(value);
+    if (found == this->range_facts.wrap_flags.end() || !inst ||
+        !llvm::isa<llvm::OverflowingBinaryOperator>(inst))
+        return;
+    if (found->second.no_signed_wrap)
+        inst->setHasNoSignedWrap();
+    if (found->second.no_unsigned_wrap)
+        inst->setHasNoUnsignedWrap();
+}
+
+void CompiledProgram::Visitor::add_range_metadata(const AstNode &node,
+                                                  llvm::LoadInst *load)
+{
+    auto found = this->range_facts.ranges.find(&node);
+    if (found == this->range_facts.ranges.end() ||
+        !load->getType()->isIntegerTy(32))
+        return;
+    // the upper bound is exclusive and may wrap around for the ranges ending
+    // at the maximal value of a type
+    auto [min, max] = found->second;
+    auto range = llvm::MDBuilder(*this->context)
+                     .createRange(llvm::APInt(32, std::uint32_t(min)),
+                                  llvm::APInt(32, std::uint32_t(max + 1)));
+    load->setMetadata(llvm::LLVMContext::MD_range, range);
+}
+
 void CompiledProgram::Visitor::visit(const BinaryExpr &node)
 {
     this->visit(*node.lhs);
     auto lhs = this->last_value;
     auto lhs_value = this->get_dereferenced_value(lhs);
 
+    if (node.op == BinOpEnum::AND || node.op == BinOpEnum::OR)
+    {
+        this->create_logical_binop(lhs_value, *node.rhs,
+                                   node.op == BinOpEnum::AND);
+        return;
+    }
+
     this->visit(*node.rhs);
     auto rhs = this->last_value;
     auto rhs_value = this->get_dereferenced_value(rhs);
@@ -393,11 +1200,52 @@ void CompiledProgram::Visitor::visit(const BinaryExpr &node)
         }
         else
             this->create_unsigned_binop(lhs_value, rhs_value, node.op);
+        this->add_wrap_flags(node, this->last_value.value);
     }
     else
         this->create_double_binop(lhs_value, rhs_value, node.op);
 }
 
+// The right operand is evaluated only when the left one doesn't decide the
+// result. Cheap operands without side effects are evaluated anyway and
+// chosen with a select, which is cheaper than a branch.
+void CompiledProgram::Visitor::create_logical_binop(llvm::Value *lhs,
+                                                    const Expression &rhs,
+                                                    const bool &is_and)
+{
+    if (is_speculatable(rhs, 2))
+    {
+        this->visit(rhs);
+        auto rhs_value = this->get_dereferenced_value(this->last_value);
+        auto new_value =
+            (is_and) ? (this->builder->CreateLogicalAnd(lhs, rhs_value))
+                     : (this->builder->CreateLogicalOr(lhs, rhs_value));
+        this->last_value = Value(new_value, this->builder->getInt1Ty());
+        return;
+    }
+    auto lhs_block = this->builder->GetInsertBlock();
+    auto rhs_block = llvm::BasicBlock::Create(*this->context, "logical_rhs",
+                                              this->current_function);
+    auto exit = llvm::BasicBlock::Create(*this->context, "logical_exit",
+                                         this->current_function);
+    if (is_and)
+        this->builder->CreateCondBr(lhs, rhs_block, exit);
+    else
+        this->builder->CreateCondBr(lhs, exit, rhs_block);
+
+    this->builder->SetInsertPoint(rhs_block);
+    this->visit(rhs);
+    auto rhs_value = this->get_dereferenced_value(this->last_value);
+    rhs_block = this->builder->GetInsertBlock();
+    this->builder->CreateBr(exit);
+
+    this->builder->SetInsertPoint(exit);
+    auto phi = this->builder->CreatePHI(this->builder->getInt1Ty(), 2);
+    phi->addIncoming(this->builder->getInt1(!is_and), lhs_block);
+    phi->addIncoming(rhs_value, rhs_block);
+    this->last_value = Value(phi, this->builder->getInt1Ty());
+}
+
 void CompiledProgram::Visitor::visit(const UnaryExpr &node)
 {
     this->visit(*node.expr);
@@ -457,6 +1305,7 @@ void CompiledProgram::Visitor::visit_call(const CallExpr &node)
     }
     auto type = callable.ptr->getReturnType();
     auto value = this->builder->CreateCall(callable.ptr, args);
+    value->setCallingConv(callable.ptr->getCallingConv());
     this->last_value = Value(value, type);
 }
 
@@ -553,13 +1402,41 @@ void CompiledProgram::Visitor::visit(const CastExpr &node)
     this->last_value = Value(new_value, new_type);
 }
 
+// Each distinct literal is emitted once, as a null-terminated array of 32-bit
+// codes. The arrays are unnamed_addr constants, so the linker can merge equal
+// ones across object files as well.
+llvm::Constant *CompiledProgram::Visitor::get_string_literal(
+    const std::wstring &value)
+{
+    if (auto found = this->string_literals.find(value);
+        found != this->string_literals.end())
+        return found->second;
+
+    std::vector<std::uint32_t> codes(value.cbegin(), value.cend());
+    codes.push_back(0);
+    auto initializer = llvm::ConstantDataArray::get(*this->context, codes);
+    auto global = new llvm::GlobalVariable(
+        *this->module, initializer->getType(), true,
+        llvm::GlobalValue::PrivateLinkage, initializer, ".str");
+    global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    global->setAlignment(llvm::Align(4));
+    auto zero = this->builder->getInt32(0);
+    auto pointer = llvm::ConstantExpr::getInBoundsGetElementPtr(
+        initializer->getType(), global,
+        llvm::ArrayRef<llvm::Constant *>{zero, zero});
+    this->string_literals.insert({value, pointer});
+    return pointer;
+}
+
 void CompiledProgram::Visitor::visit(const Expression &node)
 {
+    auto location = this->set_debug_location(get_position(node));
     std::visit(
         overloaded{[this](const VariableExpr &node) {
                        auto variable = this->find_variable(node.name);
                        auto new_value = this->builder->CreateLoad(
                            variable.type, variable.address);
+                       this->add_range_metadata(node, new_value);
                        this->last_value =
                            Value(new_value, variable.type, variable.address);
                    },
@@ -577,14 +1454,7 @@ void CompiledProgram::Visitor::visit(const Expression &node)
                        this->last_value = Value(value, type);
                    },
                    [this](const StringExpr &node) {
-                       const char *data =
-                           reinterpret_cast<const char *>(node.value.c_str());
-                       std::size_t size =
-                           (node.value.length() + 1) * sizeof(wchar_t);
-                       auto value = this->builder->CreateBitCast(
-                           this->builder->CreateGlobalStringPtr(
-                               llvm::StringRef(data, size)),
-                           llvm::Type::getInt32PtrTy(*this->context));
+                       auto value = this->get_string_literal(node.value);
                        auto type = llvm::Type::getInt32PtrTy(*this->context);
                        this->last_value = Value(value, type);
                    },
@@ -607,17 +1477,26 @@ void CompiledProgram::Visitor::visit(const Expression &node)
                    [this](const CastExpr &node) { this->visit(node); }},
 
         node);
+    this->reset_debug_location(location);
 }
 
 void CompiledProgram::Visitor::visit_block(const Block &node)
 {
     auto is_return_covered = false;
     this->enter_scope();
+    if (this->debug_builder)
+        this->debug_scopes.push_back(this->debug_builder->createLexicalBlock(
+            this->debug_scopes.back(), this->debug_unit->getFile(),
+            node.position.line, node.position.column));
     for (const auto &stmt : node.statements)
     {
+        // statements that don't return never touch the flag
+        this->is_return_covered = false;
         this->visit(*stmt);
         is_return_covered |= this->is_return_covered;
     }
+    if (this->debug_builder)
+        this->debug_scopes.pop_back();
     this->leave_scope();
     this->is_return_covered = is_return_covered;
 }
@@ -647,13 +1526,15 @@ void CompiledProgram::Visitor::visit(const IfStmt &node)
     this->builder->SetInsertPoint(then_entry);
     this->visit(*node.then_block);
     auto is_then_covered = this->is_return_covered;
-    this->builder->CreateBr(exit);
+    if (!this->is_return_covered)
+        this->builder->CreateBr(exit);
 
     if (node.else_block)
     {
         this->builder->SetInsertPoint(else_entry);
         this->visit(*node.else_block);
-        this->builder->CreateBr(exit);
+        if (!this->is_return_covered)
+            this->builder->CreateBr(exit);
         this->is_return_covered &= is_then_covered;
     }
     else
@@ -721,7 +1602,24 @@ void CompiledProgram::Visitor::visit(const MatchStmt &node)
     this->builder->SetInsertPoint(condition);
 
     auto is_return_covered = true;
-    for (const auto &arm : node.match_arms)
+    auto switch_arms = (matched_value->getType()->isIntegerTy())
+                           ? (count_switch_arms(node))
+                           : (0);
+    if (switch_arms > 0)
+    {
+        auto default_dest = llvm::BasicBlock::Create(
+            *this->context, "match_condition", this->current_function);
+        auto switch_inst =
+            this->builder->CreateSwitch(matched_value, default_dest);
+        for (const auto &arm : node.match_arms | std::views::take(switch_arms))
+        {
+            this->visit_switch_arm(std::get<LiteralArm>(*arm), switch_inst);
+            is_return_covered &= this->is_return_covered;
+        }
+        this->builder->SetInsertPoint(default_dest);
+        this->match_condition = default_dest;
+    }
+    for (const auto &arm : node.match_arms | std::views::drop(switch_arms))
     {
         this->visit(*arm);
         is_return_covered &= this->is_return_covered;
@@ -747,6 +1645,16 @@ void CompiledProgram::Visitor::visit(const AssignStmt &node)
     this->visit(*node.lhs);
     auto ptr = this->last_value.address;
     auto lhs = this->last_value;
+    // `&=` and `|=` on bools short-circuit, just like `&&` and `||`
+    if (lhs.type->isIntegerTy(1) &&
+        (node.op == BinOpEnum::BIT_AND || node.op == BinOpEnum::BIT_OR))
+    {
+        this->create_logical_binop(lhs.value, *node.rhs,
+                                   node.op == BinOpEnum::BIT_AND);
+        this->builder->CreateStore(this->last_value.value, ptr);
+        this->is_return_covered = false;
+        return;
+    }
     this->visit(*node.rhs);
     auto rhs = this->last_value;
     auto stored_value = rhs.value;
@@ -760,6 +1668,7 @@ void CompiledProgram::Visitor::visit(const AssignStmt &node)
             }
             else
                 this->create_unsigned_binop(lhs.value, rhs.value, *node.op);
+            this->add_wrap_flags(node, this->last_value.value);
         }
         else
             this->create_double_binop(lhs.value, rhs.value, *node.op);
@@ -775,10 +1684,31 @@ void CompiledProgram::Visitor::declare_global(const VarDeclStmt &node)
     auto value = this->last_value;
     auto type = (node.type) ? (this->get_var_type(*node.type)) : (value.type);
 
+    // globals can't be accessed from outside of the module
+    auto name = std::string(node.name.cbegin(), node.name.cend());
     auto ptr = new llvm::GlobalVariable(
-        *this->module, type, !node.is_mut, llvm::GlobalValue::ExternalLinkage,
-        llvm::cast<llvm::Constant>(value.value));
-    this->globals.insert({node.name, Value{ptr, type}});
+        *this->module, type, !node.is_mut, llvm::GlobalValue::InternalLinkage,
+        llvm::cast<llvm::Constant>(value.value), name);
+    this->globals.insert({node.name, Value{ptr, type, ptr}});
+    if (this->debug_builder)
+    {
+        auto debug_type = (node.type) ? (this->get_debug_type(*node.type))
+                                      : (this->get_debug_type(type));
+        ptr->addDebugInfo(this->debug_builder->createGlobalVariableExpression(
+            this->debug_unit, name, "", this->debug_unit->getFile(),
+            node.position.line, debug_type, true));
+    }
+}
+
+// Every stack slot lives in the entry block, regardless of where its variable
+// is declared. Such allocas are static, so they don't grow the stack when
+// their declaration sits in a loop, and SROA can promote them to registers.
+llvm::AllocaInst *CompiledProgram::Visitor::create_entry_alloca(
+    llvm::Type *type)
+{
+    auto &entry = this->current_function->getEntryBlock();
+    auto builder = llvm::IRBuilder<>(&entry, entry.begin());
+    return builder.CreateAlloca(type);
 }
 
 void CompiledProgram::Visitor::visit(const VarDeclStmt &node)
@@ -788,20 +1718,64 @@ void CompiledProgram::Visitor::visit(const VarDeclStmt &node)
     auto type = (node.type) ? (this->get_var_type(*node.type))
                             : (this->last_value.type);
 
-    auto ptr = this->builder->CreateAlloca(type);
+    auto ptr = this->create_entry_alloca(type);
     this->builder->CreateStore(value, ptr);
     this->variables.back().insert({node.name, Value{value, type, ptr}});
+    if (this->debug_builder)
+        this->declare_debug_variable(
+            ptr, node.name, node.position,
+            (node.type) ? (this->get_debug_type(*node.type))
+                        : (this->get_debug_type(type)));
     this->is_return_covered = false;
 }
 
+// Functions that don't (transitively) call externs can neither unwind nor
+// synchronize, as Mole has no exceptions or threads of its own. Externs are
+// opaque, so they and their callers keep the default, conservative attributes.
+void CompiledProgram::Visitor::add_effect_attributes(
+    llvm::Function *func, const FunctionEffects &effects)
+{
+    if (effects.calls_externs)
+        return;
+    func->addFnAttr(llvm::Attribute::NoUnwind);
+    func->addFnAttr(llvm::Attribute::NoSync);
+    if (!effects.may_not_return)
+        func->addFnAttr(llvm::Attribute::WillReturn);
+
+    auto get_mod_ref = [](const bool &reads, const bool &writes) {
+        if (writes)
+            return llvm::ModRefInfo::ModRef;
+        return (reads) ? (llvm::ModRefInfo::Ref)
+                       : (llvm::ModRefInfo::NoModRef);
+    };
+    auto memory =
+        llvm::MemoryEffects::argMemOnly(
+            get_mod_ref(effects.reads_args, effects.writes_args)) |
+        llvm::MemoryEffects(
+            llvm::MemoryEffects::Location::Other,
+            get_mod_ref(effects.reads_globals, effects.writes_globals));
+    func->setMemoryEffects(memory);
+}
+
 void CompiledProgram::Visitor::declare_func(const FuncDef &node)
 {
     auto type = this->get_fn_type(node);
     auto name = std::string(node.name.cbegin(), node.name.cend());
-    auto func = llvm::Function::Create(type, llvm::Function::ExternalLinkage,
-                                       name, *this->module);
-    func->setCallingConv(llvm::CallingConv::C);
-    func->arg_begin();
+    // only exported functions can be called from outside of the module, so
+    // the remaining ones are free to use a faster calling convention and can
+    // be removed when unused
+    auto is_exported = node.is_exported || node.name == L"main";
+    auto linkage = (is_exported) ? (llvm::Function::ExternalLinkage)
+                                 : (llvm::Function::InternalLinkage);
+    auto func = llvm::Function::Create(type, linkage, name, *this->module);
+    func->setCallingConv((is_exported) ? (llvm::CallingConv::C)
+                                       : (llvm::CallingConv::Fast));
+    this->add_effect_attributes(func, this->effects.at(node.name));
+    // the vectorizers and the backend only use the features that functions
+    // ask for explicitly
+    func->addFnAttr("target-cpu", this->target_cpu);
+    if (!this->target_features.empty())
+        func->addFnAttr("target-features", this->target_features);
 
     this->functions.insert({node.name, Function{func, type}});
 }
@@ -809,25 +1783,52 @@ void CompiledProgram::Visitor::declare_func(const FuncDef &node)
 void CompiledProgram::Visitor::visit(const FuncDef &node)
 {
     auto func = this->functions.at(node.name);
+    llvm::TimeTraceScope scope("LowerFunction", func.ptr->getName());
 
     auto entry =
         llvm::BasicBlock::Create(*this->context, "fn_entry", func.ptr);
     this->builder->SetInsertPoint(entry);
+    this->current_function = func.ptr;
+    if (this->debug_builder)
+    {
+        auto subprogram = this->debug_builder->createFunction(
+            this->debug_unit->getFile(), func.ptr->getName(), "",
+            this->debug_unit->getFile(), node.position.line,
+            this->get_debug_fn_type(node), node.position.line,
+            llvm::DINode::FlagPrototyped,
+            llvm::DISubprogram::toSPFlags(func.ptr->hasLocalLinkage(), true,
+                                          false));
+        func.ptr->setSubprogram(subprogram);
+        this->debug_scopes.push_back(subprogram);
+    }
+    auto location = this->set_debug_location(node.position);
     this->enter_scope();
     for (const auto &[param, arg] :
          std::views::zip(node.params, func.ptr->args()))
     {
-        auto param_ptr = this->builder->CreateAlloca(arg.getType());
+        auto param_ptr = this->create_entry_alloca(arg.getType());
         this->variables.back().insert(
             {param->name, Value{param_ptr, arg.getType(), param_ptr}});
         this->builder->CreateStore(&arg, param_ptr);
+        if (this->debug_builder)
+            this->declare_debug_variable(param_ptr, param->name,
+                                         param->position,
+                                         this->get_debug_type(param->type),
+                                         arg.getArgNo() + 1);
     }
-    this->current_function = func.ptr;
     this->visit_block(*node.block);
     if (!this->is_return_covered && !node.return_type)
         this->builder->CreateRetVoid();
+    // the exit block of a statement whose every branch returns is never
+    // reached, but still needs a terminator
+    else if (this->is_return_covered &&
+             !this->builder->GetInsertBlock()->getTerminator())
+        this->builder->CreateUnreachable();
 
     this->leave_scope();
+    this->reset_debug_location(location);
+    if (this->debug_builder)
+        this->debug_scopes.pop_back();
 }
 
 void CompiledProgram::Visitor::visit(const ExternDef &node)
@@ -843,6 +1844,7 @@ void CompiledProgram::Visitor::visit(const ExternDef &node)
 
 void CompiledProgram::Visitor::visit(const Statement &node)
 {
+    auto location = this->set_debug_location(get_position(node));
     std::visit(
         overloaded{[this](const Block &node) { this->visit_block(node); },
                    [this](const WhileStmt &node) { this->visit(node); },
@@ -861,6 +1863,7 @@ void CompiledProgram::Visitor::visit(const Statement &node)
                    [this](const ExprStmt &node) { this->visit(*node.expr); },
                    [this](const VarDeclStmt &node) { this->visit(node); }},
         node);
+    this->reset_debug_location(location);
 }
 
 llvm::Value *CompiledProgram::Visitor::create_literal_condition_value(
@@ -897,6 +1900,25 @@ void CompiledProgram::Visitor::visit(const LiteralArm &node)
     this->match_condition = new_condition;
 }
 
+void CompiledProgram::Visitor::visit_switch_arm(const LiteralArm &node,
+                                                llvm::SwitchInst *switch_inst)
+{
+    auto stmt = llvm::BasicBlock::Create(*this->context, "match_stmt",
+                                         this->current_function);
+    for (const auto &literal : node.literals)
+    {
+        this->visit(*literal);
+        auto value = llvm::cast<llvm::ConstantInt>(this->last_value.value);
+        // a value repeated in a later arm can never reach that arm
+        if (switch_inst->findCaseValue(value) == switch_inst->case_default())
+            switch_inst->addCase(value, stmt);
+    }
+    this->builder->SetInsertPoint(stmt);
+    this->visit(*node.block);
+    if (!this->is_return_covered)
+        this->builder->CreateBr(this->match_exit);
+}
+
 void CompiledProgram::Visitor::visit(const GuardArm &node)
 {
     auto stmt = llvm::BasicBlock::Create(*this->context, "match_stmt",
@@ -928,15 +1950,19 @@ void CompiledProgram::Visitor::visit(const ElseArm &node)
 
 void CompiledProgram::Visitor::visit(const MatchArm &node)
 {
+    auto location = this->set_debug_location(get_position(node));
     std::visit(
         overloaded{[this](const LiteralArm &node) { this->visit(node); },
                    [this](const GuardArm &node) { this->visit(node); },
                    [this](const ElseArm &node) { this->visit(node); }},
         node);
+    this->reset_debug_location(location);
 }
 
 void CompiledProgram::Visitor::visit(const Program &node)
 {
+    this->effects = EffectAnalyzer().analyze(node);
+    this->range_facts = RangeAnalyzer().analyze(node);
     for (const auto &func : node.functions)
         this->declare_func(*func);
     for (const auto &ext : node.externs)
@@ -952,49 +1978,345 @@ void CompiledProgram::output_bytecode(llvm::raw_fd_ostream &output)
     llvm::WriteBitcodeToFile(*this->visitor.module, output);
 }
 
-void CompiledProgram::output_ir(llvm::raw_fd_ostream &output)
+void CompiledProgram::output_ir(llvm::raw_ostream &output)
 {
     output << *this->visitor.module;
 }
 
-void CompiledProgram::Visitor::optimize()
+ModuleSize CompiledProgram::get_size() const
 {
-    auto pass_manager = std::make_unique<llvm::legacy::FunctionPassManager>(
-        this->module.get());
-    pass_manager->add(llvm::createInstructionCombiningPass());
-    pass_manager->add(llvm::createReassociatePass());
-    pass_manager->add(llvm::createGVNPass());
-    pass_manager->add(llvm::createCFGSimplificationPass());
-    pass_manager->doInitialization();
-    for (auto &function : this->functions
-         //  | std::views::filter([](const auto &pair) {
-         //      return pair.first != L"main";
-         //  })
-    )
+    auto size = ModuleSize();
+    for (const auto &function : *this->visitor.module)
     {
-        pass_manager->run(*(function.second.ptr));
+        if (function.isDeclaration())
+            continue;
+        ++size.functions;
+        size.basic_blocks += function.size();
+        size.instructions += function.getInstructionCount();
     }
+    return size;
 }
 
-void CompiledProgram::Visitor::output_object_file(llvm::raw_fd_ostream &output)
+void CompiledProgram::Visitor::optimize(
+    const llvm::OptimizationLevel &level,
+    llvm::PassInstrumentationCallbacks *callbacks,
+    const ProfileOptions &profile)
 {
-    llvm::legacy::PassManager pass_manager;
-    auto type = llvm::CodeGenFileType::CGFT_ObjectFile;
-    if (this->target_machine->addPassesToEmitFile(pass_manager, output,
-                                                  nullptr, type))
+    check_profile(profile);
+    run_pipeline(*this->module, this->target_machine.get(), level, callbacks,
+                 profile);
+    this->target_machine->setOptLevel(get_codegen_level(level));
+}
+
+std::unique_ptr<llvm::Module> CompiledProgram::Visitor::get_optimized_function(
+    const llvm::Function &function,
+    const std::unordered_set<const llvm::GlobalValue *> &symbols,
+    const llvm::OptimizationLevel &level, CompilationCache &cache,
+    const std::vector<std::string> &key_options)
+{
+    llvm::TimeTraceScope scope("OptimizeFunction", function.getName());
+    auto part = extract_function(*this->module, function, symbols);
+    std::string ir;
+    auto stream = llvm::raw_string_ostream(ir);
+    stream << *part;
+    stream.flush();
+    auto key = CompilationCache::get_key(ir, key_options);
+    if (auto bitcode = cache.load_data(key))
+    {
+        auto cached = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(*bitcode, "cached"), *this->context);
+        if (cached)
+            return std::move(*cached);
+        llvm::consumeError(cached.takeError());
+    }
+
+    run_pipeline(*part, this->target_machine.get(), level);
+    llvm::SmallString<0> bitcode;
+    auto bitcode_stream = llvm::raw_svector_ostream(bitcode);
+    llvm::WriteBitcodeToFile(*part, bitcode_stream);
+    cache.store_data(key, bitcode.str().str());
+    return part;
+}
+
+// The functions are keyed on their lowered code, which already includes the
+// signatures and attributes of everything they use. They're linked back by
+// name, so the program's own globals and functions have to stay external
+// until then.
+void CompiledProgram::Visitor::optimize_incrementally(
+    const llvm::OptimizationLevel &level, CompilationCache &cache,
+    const std::vector<std::string> &key_options)
+{
+    auto symbols = std::unordered_set<const llvm::GlobalValue *>();
+    for (const auto &[name, function] : this->functions)
+        symbols.insert(function.ptr);
+    for (const auto &[name, global] : this->globals)
+        symbols.insert(llvm::cast<llvm::GlobalValue>(global.value));
+    auto options = key_options;
+    options.push_back(std::to_string(level.getSpeedupLevel()) + "/" +
+                      std::to_string(level.getSizeLevel()));
+
+    std::vector<std::unique_ptr<llvm::Module>> parts;
+    for (const auto &function : this->module->functions())
+    {
+        if (symbols.contains(&function) && !function.isDeclaration())
+            parts.push_back(this->get_optimized_function(
+                function, symbols, level, cache, options));
+    }
+
+    std::vector<std::pair<std::string, llvm::GlobalValue::LinkageTypes>>
+        linkages;
+    for (auto &global : this->module->global_values())
+    {
+        if (!symbols.contains(&global))
+            continue;
+        linkages.push_back({global.getName().str(), global.getLinkage()});
+        global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        if (auto function = llvm::dyn_cast<llvm::Function>(&global))
+            function->deleteBody();
+    }
+    for (auto &function :
+         llvm::make_early_inc_range(this->module->functions()))
+    {
+        if (function.hasLocalLinkage() && function.use_empty())
+            function.eraseFromParent();
+    }
+    for (auto &global : llvm::make_early_inc_range(this->module->globals()))
+    {
+        if (global.hasLocalLinkage() && global.use_empty())
+            global.eraseFromParent();
+    }
+    for (auto &part : parts)
     {
+        if (llvm::Linker::linkModules(*this->module, std::move(part)))
+            throw CompilationException("The optimized functions couldn't be "
+                                       "linked.");
+    }
+    for (const auto &[name, linkage] : linkages)
+        this->module->getNamedValue(name)->setLinkage(linkage);
+
+    this->target_machine->setOptLevel(get_codegen_level(level));
+}
+
+// The partitions are merged with the host's `ld`, which can't link the
+// objects of other targets, so those are always emitted on a single thread.
+void CompiledProgram::Visitor::output_object_file(llvm::raw_fd_ostream &output,
+                                                  const unsigned &threads)
+{
+    auto module_id = llvm::getUniqueModuleId(this->module.get());
+    auto target = this->target_machine->getTargetTriple();
+    auto host = llvm::Triple(llvm::sys::getDefaultTargetTriple());
+    auto is_host_target = target.getArch() == host.getArch() &&
+                          target.getOS() == host.getOS() &&
+                          target.getObjectFormat() == host.getObjectFormat();
+    if (threads > 1 && !module_id.empty() && is_host_target)
+    {
+        this->output_split_object_file(output, threads, module_id);
+        return;
+    }
+    if (!emit_object_file(*this->module, *this->target_machine, output))
         throw CompilationException("The object file couldn't be emitted.");
+    output.flush();
+}
+
+// The module is split into partitions which are emitted into temporary
+// objects concurrently, each in its own context and with its own target
+// machine, and then merged back into one object with a relocatable link.
+// Internal symbols referenced across partitions have to become hidden
+// globals, so they get suffixed with a hash of the module's exported symbols
+// the same way ThinLTO promotes them, which keeps them from clashing with
+// the ones of other objects.
+void CompiledProgram::Visitor::output_split_object_file(
+    llvm::raw_fd_ostream &output, const unsigned &threads,
+    const std::string &module_id)
+{
+    auto linker = llvm::sys::findProgramByName("ld");
+    if (!linker)
+        throw CompilationException("The linker needed to merge the object "
+                                   "file's partitions wasn't found.");
+
+    for (auto &value : this->module->global_values())
+    {
+        if (value.hasLocalLinkage())
+            value.setName(value.getName() + ".llvm." + module_id);
+    }
+    std::vector<llvm::SmallString<0>> partitions;
+    llvm::SplitModule(*this->module, threads,
+                      [&](std::unique_ptr<llvm::Module> partition) {
+                          auto &bitcode = partitions.emplace_back();
+                          auto stream = llvm::raw_svector_ostream(bitcode);
+                          llvm::WriteBitcodeToFile(*partition, stream);
+                      });
+
+    // the last of the temporary files is the merged object
+    std::vector<std::string> paths;
+    std::vector<std::unique_ptr<llvm::FileRemover>> removers;
+    for (std::size_t i = 0; i <= partitions.size(); ++i)
+    {
+        llvm::SmallString<128> path;
+        if (llvm::sys::fs::createTemporaryFile("mole", "o", path))
+            throw CompilationException("A temporary file couldn't be "
+                                       "created.");
+        paths.push_back(path.str().str());
+        removers.push_back(std::make_unique<llvm::FileRemover>(path));
     }
-    pass_manager.run(*this->module);
+
+    std::vector<std::string> errors(partitions.size());
+    llvm::ThreadPool pool(llvm::hardware_concurrency(threads));
+    for (std::size_t i = 0; i < partitions.size(); ++i)
+    {
+        pool.async([&, i] {
+            errors[i] = emit_partition(partitions[i], paths[i],
+                                       *this->target_machine);
+        });
+    }
+    pool.wait();
+    for (const auto &error : errors)
+    {
+        if (!error.empty())
+            throw CompilationException(error);
+    }
+
+    auto merged = paths.back();
+    std::vector<llvm::StringRef> args = {*linker, "-r", "-o", merged};
+    args.insert(args.end(), paths.begin(), paths.end() - 1);
+    if (llvm::sys::ExecuteAndWait(*linker, args) != 0)
+        throw CompilationException("The object file's partitions couldn't "
+                                   "be linked.");
+    auto buffer = llvm::MemoryBuffer::getFile(merged);
+    if (!buffer)
+        throw CompilationException(buffer.getError().message());
+    output << (*buffer)->getBuffer();
     output.flush();
 }
 
-void CompiledProgram::output_object_file(llvm::raw_fd_ostream &output)
+// The module and its context are handed over to the JIT, so the program can't
+// be output or executed again afterwards.
+int CompiledProgram::Visitor::execute(const std::vector<std::string> &args)
+{
+    auto returns_value = check_executable(this->module.get());
+    auto machine_builder = get_jit_machine_builder(
+        *this->module, this->target_cpu, this->target_features,
+        this->target_machine->getOptLevel());
+    auto jit = get_or_throw(llvm::orc::LLJITBuilder()
+                                .setJITTargetMachineBuilder(machine_builder)
+                                .create());
+    add_process_symbols(*jit);
+    throw_if_error(jit->addIRModule(llvm::orc::ThreadSafeModule(
+        std::move(this->module), std::move(this->context))));
+    return run_main(*jit, returns_value, args);
+}
+
+// Every function is extracted into a module of its own once it's first
+// called, which then gets optimized and compiled separately. Each partition
+// gets its own target machine, as they may be compiled concurrently.
+int CompiledProgram::Visitor::execute_lazily(
+    const std::vector<std::string> &args, const llvm::OptimizationLevel &level,
+    const unsigned &threads)
+{
+    auto returns_value = check_executable(this->module.get());
+    auto machine_builder = get_jit_machine_builder(
+        *this->module, this->target_cpu, this->target_features,
+        get_codegen_level(level));
+    // partitions are compiled on the JIT's threads, which are joined when
+    // it's destroyed, so the mutex has to outlive it
+    auto compiled_mutex = std::mutex();
+    this->compiled_functions.clear();
+    auto jit = get_or_throw(llvm::orc::LLLazyJITBuilder()
+                                .setJITTargetMachineBuilder(machine_builder)
+                                .setNumCompileThreads(threads)
+                                .create());
+    add_process_symbols(*jit);
+
+    // Only functions visible outside of the module get lazy stubs. The
+    // internal ones would be renamed and compiled along with their first
+    // caller, so they're made external for the JIT.
+    auto defined = std::unordered_set<std::string>();
+    for (auto &function : *this->module)
+    {
+        if (function.isDeclaration())
+            continue;
+        if (function.hasLocalLinkage())
+            function.setLinkage(llvm::Function::ExternalLinkage);
+        defined.insert(function.getName().str());
+    }
+    auto &lazy_jit = *jit;
+    jit->getIRTransformLayer().setTransform(
+        [&lazy_jit, &compiled_mutex, &compiled = this->compiled_functions,
+         machine_builder, level, threads,
+         defined](llvm::orc::ThreadSafeModule module,
+                  llvm::orc::MaterializationResponsibility &)
+            -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+            auto builder = machine_builder;
+            auto target_machine = builder.createTargetMachine();
+            if (!target_machine)
+                return target_machine.takeError();
+            module.withModuleDo([&](llvm::Module &partition) {
+                {
+                    auto lock = std::lock_guard(compiled_mutex);
+                    for (const auto &function : partition)
+                    {
+                        if (!function.isDeclaration())
+                            compiled.insert(function.getName().str());
+                    }
+                }
+                run_pipeline(partition, target_machine->get(), level);
+                // without compile threads the callees would be compiled
+                // right away, which defeats the purpose of being lazy
+                if (threads > 0)
+                    compile_callees(lazy_jit, partition, defined);
+            });
+            return module;
+        });
+    throw_if_error(jit->addLazyIRModule(llvm::orc::ThreadSafeModule(
+        std::move(this->module), std::move(this->context))));
+    return run_main(*jit, returns_value, args);
+}
+
+void CompiledProgram::output_object_file(llvm::raw_fd_ostream &output,
+                                         const unsigned &threads)
+{
+    this->visitor.output_object_file(output, threads);
+}
+
+void CompiledProgram::optimize(const llvm::OptimizationLevel &level,
+                               llvm::PassInstrumentationCallbacks *callbacks,
+                               const ProfileOptions &profile)
+{
+    this->visitor.optimize(level, callbacks, profile);
+}
+
+void CompiledProgram::optimize_incrementally(
+    const llvm::OptimizationLevel &level, CompilationCache &cache,
+    const std::vector<std::string> &key_options)
+{
+    this->visitor.optimize_incrementally(level, cache, key_options);
+}
+
+int CompiledProgram::execute(const std::vector<std::string> &args)
+{
+    return this->visitor.execute(args);
+}
+
+int CompiledProgram::execute_lazily(const std::vector<std::string> &args,
+                                    const llvm::OptimizationLevel &level,
+                                    const unsigned &threads)
+{
+    return this->visitor.execute_lazily(args, level, threads);
+}
+
+const std::unordered_set<std::string> &CompiledProgram::
+    get_compiled_functions() const
+{
+    return this->visitor.compiled_functions;
+}
+
+std::unique_ptr<llvm::TargetMachine> CompiledProgram::Visitor::
+    release_target_machine()
 {
-    this->visitor.output_object_file(output);
+    return std::move(this->target_machine);
 }
 
-void CompiledProgram::optimize()
+std::unique_ptr<llvm::TargetMachine> CompiledProgram::release_target_machine()
 {
-    this->visitor.optimize();
+    return this->visitor.release_target_machine();
 }
\ No newline at end of file
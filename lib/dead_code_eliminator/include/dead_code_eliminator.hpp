@@ -0,0 +1,66 @@
+#ifndef __DEAD_CODE_ELIMINATOR_HPP__
+#define __DEAD_CODE_ELIMINATOR_HPP__
+#include "logger.hpp"
+#include "visitor.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+struct EliminationStats
+{
+    std::size_t functions = 0, globals = 0, externs = 0;
+};
+
+// Removes top-level items that can't be reached from the program's roots
+// before code generation. The roots are the `main` function and the functions
+// marked with `@export`, as only these can be called from outside of the
+// compiled object file.
+class DeadCodeEliminator : public Reporter
+{
+    class Visitor : public ExprVisitor,
+                    public StmtVisitor,
+                    public MatchArmVisitor,
+                    public ProgramVisitor
+    {
+        std::unordered_map<std::wstring, std::unordered_set<std::wstring>>
+            references;
+        std::unordered_set<std::wstring> *current_references;
+
+        void visit(const BinaryExpr &node);
+        void visit(const UnaryExpr &node);
+        void visit_call(const CallExpr &node);
+        void visit(const IndexExpr &node);
+        void visit(const CastExpr &node);
+
+        void visit_block(const Block &node);
+        void visit(const IfStmt &node);
+        void visit(const WhileStmt &node);
+        void visit(const MatchStmt &node);
+        void visit(const ReturnStmt &node);
+        void visit(const AssignStmt &node);
+        void visit(const VarDeclStmt &node);
+
+        void visit(const LiteralArm &node);
+        void visit(const GuardArm &node);
+        void visit(const ElseArm &node);
+
+        void visit(const FuncDef &node);
+
+      public:
+        std::unordered_set<std::wstring> reachable;
+
+        Visitor() noexcept;
+        void visit(const Expression &node) override;
+        void visit(const Statement &node) override;
+        void visit(const MatchArm &node) override;
+        void visit(const Program &node) override;
+    } visitor;
+
+    template <typename Item>
+    std::size_t remove_unreachable(std::vector<std::unique_ptr<Item>> &items,
+                                   const wchar_t *kind);
+
+  public:
+    EliminationStats eliminate(Program &program);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include "dead_code_eliminator.hpp"
+#include <vector>
+
+DeadCodeEliminator::Visitor::Visitor() noexcept : current_references(nullptr)
+{
+}
+
+void DeadCodeEliminator::Visitor::visit(const BinaryExpr &node)
+{
+    this->visit(*node.lhs);
+    this->visit(*node.rhs);
+}
+
+void DeadCodeEliminator::Visitor::visit(const UnaryExpr &node)
+{
+    this->visit(*node.expr);
+}
+
+void DeadCodeEliminator::Visitor::visit_call(const CallExpr &node)
+{
+    this->current_references->insert(node.callable);
+    for (const auto &arg : node.args)
+        this->visit(*arg);
+}
+
+void DeadCodeEliminator::Visitor::visit(const IndexExpr &node)
+{
+    this->visit(*node.expr);
+    this->visit(*node.index_value);
+}
+
+void DeadCodeEliminator::Visitor::visit(const CastExpr &node)
+{
+    this->visit(*node.expr);
+}
+
+void DeadCodeEliminator::Visitor::visit(const Expression &node)
+{
+    std::visit(
+        overloaded{[this](const VariableExpr &node) {
+                       this->current_references->insert(node.name);
+                   },
+                   [this](const BinaryExpr &node) { this->visit(node); },
+                   [this](const UnaryExpr &node) { this->visit(node); },
+                   [this](const CallExpr &node) { this->visit_call(node); },
+                   [this](const IndexExpr &node) { this->visit(node); },
+                   [this](const CastExpr &node) { this->visit(node); },
+                   [](const auto &) {}},
+        node);
+}
+
+void DeadCodeEliminator::Visitor::visit_block(const Block &node)
+{
+    for (const auto &stmt : node.statements)
+        this->visit(*stmt);
+}
+
+void DeadCodeEliminator::Visitor::visit(const IfStmt &node)
+{
+    this->visit(*node.condition_expr);
+    this->visit(*node.then_block);
+    if (node.else_block)
+        this->visit(*node.else_block);
+}
+
+void DeadCodeEliminator::Visitor::visit(const WhileStmt &node)
+{
+    this->visit(*node.condition_expr);
+    this->visit(*node.statement);
+}
+
+void DeadCodeEliminator::Visitor::visit(const MatchStmt &node)
+{
+    this->visit(*node.matched_expr);
+    for (const auto &arm : node.match_arms)
+        this->visit(*arm);
+}
+
+void DeadCodeEliminator::Visitor::visit(const ReturnStmt &node)
+{
+    if (node.expr)
+        this->visit(*node.expr);
+}
+
+void DeadCodeEliminator::Visitor::visit(const AssignStmt &node)
+{
+    this->visit(*node.lhs);
+    this->visit(*node.rhs);
+}
+
+void DeadCodeEliminator::Visitor::visit(const VarDeclStmt &node)
+{
+    if (node.initial_value)
+        this->visit(*node.initial_value);
+}
+
+void DeadCodeEliminator::Visitor::visit(const Statement &node)
+{
+    std::visit(
+        overloaded{[this](const Block &node) { this->visit_block(node); },
+                   [this](const IfStmt &node) { this->visit(node); },
+                   [this](const WhileStmt &node) { this->visit(node); },
+                   [this](const MatchStmt &node) { this->visit(node); },
+                   [this](const ReturnStmt &node) { this->visit(node); },
+                   [this](const AssignStmt &node) { this->visit(node); },
+                   [this](const ExprStmt &node) { this->visit(*node.expr); },
+                   [this](const VarDeclStmt &node) { this->visit(node); },
+                   [](const BreakStmt &) {},
+                   [](const ContinueStmt &) {}},
+        node);
+}
+
+void DeadCodeEliminator::Visitor::visit(const LiteralArm &node)
+{
+    for (const auto &literal : node.literals)
+        this->visit(*literal);
+    this->visit(*node.block);
+}
+
+void DeadCodeEliminator::Visitor::visit(const GuardArm &node)
+{
+    this->visit(*node.condition_expr);
+    this->visit(*node.block);
+}
+
+void DeadCodeEliminator::Visitor::visit(const ElseArm &node)
+{
+    this->visit(*node.block);
+}
+
+void DeadCodeEliminator::Visitor::visit(const MatchArm &node)
+{
+    std::visit(
+        overloaded{[this](const LiteralArm &node) { this->visit(node); },
+                   [this](const GuardArm &node) { this->visit(node); },
+                   [this](const ElseArm &node) { this->visit(node); }},
+        node);
+}
+
+void DeadCodeEliminator::Visitor::visit(const FuncDef &node)
+{
+    this->current_references = &this->references[node.name];
+    this->visit_block(*node.block);
+}
+
+// Builds the reference graph of the top-level items and marks everything
+// reachable from the roots. Locals can't shadow top-level names, so every
+// referenced name matching one of them refers to that item.
+void DeadCodeEliminator::Visitor::visit(const Program &node)
+{
+    this->references.clear();
+    this->reachable.clear();
+
+    for (const auto &var : node.globals)
+    {
+        this->current_references = &this->references[var->name];
+        this->visit(*var);
+    }
+    for (const auto &func : node.functions)
+        this->visit(*func);
+    this->current_references = nullptr;
+
+    std::vector<std::wstring> pending;
+    for (const auto &func : node.functions)
+    {
+        if (func->is_exported || func->name == L"main")
+            pending.push_back(func->name);
+    }
+    this->reachable.insert(pending.begin(), pending.end());
+    while (!pending.empty())
+    {
+        auto current = std::move(pending.back());
+        pending.pop_back();
+        auto found = this->references.find(current);
+        if (found == this->references.end())
+            continue;
+        for (const auto &name : found->second)
+        {
+            if (this->reachable.insert(name).second)
+                pending.push_back(name);
+        }
+    }
+}
+
+template <typename Item>
+std::size_t DeadCodeEliminator::remove_unreachable(
+    std::vector<std::unique_ptr<Item>> &items, const wchar_t *kind)
+{
+    return std::erase_if(items, [this, &kind](const auto &item) {
+        if (this->visitor.reachable.contains(item->name))
+            return false;
+        this->report(LogLevel::INFO, item->position,
+                     L"Dead code elimination at [", item->position.line, ",",
+                     item->position.column, "]: removed unused ", kind, " \"",
+                     item->name, "\".");
+        return true;
+    });
+}
+
+EliminationStats DeadCodeEliminator::eliminate(Program &program)
+{
+    this->visitor.visit(program);
+    return EliminationStats{
+        .functions = this->remove_unreachable(program.functions, L"function"),
+        .globals = this->remove_unreachable(program.globals, L"global"),
+        .externs = this->remove_unreachable(program.externs, L"extern")};
+}
\ No newline at end of file
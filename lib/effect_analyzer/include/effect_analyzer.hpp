@@ -0,0 +1,89 @@
+#ifndef __EFFECT_ANALYZER_HPP__
+#define __EFFECT_ANALYZER_HPP__
+#include "visitor.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Side effects of a single function, including everything that happens in
+// the functions it calls. Accesses to immutable globals and to locals are not
+// side effects, as the former live in constant memory and the latter never
+// leave the function's frame.
+struct FunctionEffects
+{
+    bool reads_globals = false, writes_globals = false;
+    bool reads_args = false, writes_args = false;
+    bool calls_externs = false, may_not_return = false;
+
+    FunctionEffects &operator|=(const FunctionEffects &other) noexcept;
+    bool operator==(const FunctionEffects &) const noexcept = default;
+};
+
+using EffectMap = std::unordered_map<std::wstring, FunctionEffects>;
+
+class EffectAnalyzer
+{
+    class Visitor : public ExprVisitor,
+                    public StmtVisitor,
+                    public MatchArmVisitor,
+                    public ProgramVisitor
+    {
+        struct Call
+        {
+            std::wstring callee;
+            bool forwards_params;
+        };
+
+        struct Summary
+        {
+            FunctionEffects effects;
+            std::vector<Call> calls;
+        };
+
+        std::unordered_set<std::wstring> mutable_globals, externs, ref_params,
+            mut_ref_params;
+        std::unordered_map<std::wstring, Summary> summaries;
+        Summary *current_summary;
+        bool is_written, is_dereferenced, uses_ref_params;
+
+        void visit(const BinaryExpr &node);
+        void visit(const UnaryExpr &node);
+        void visit_call(const CallExpr &node);
+        void visit(const IndexExpr &node);
+        void visit(const CastExpr &node);
+        void visit(const VariableExpr &node);
+
+        void visit_block(const Block &node);
+        void visit(const IfStmt &node);
+        void visit(const WhileStmt &node);
+        void visit(const MatchStmt &node);
+        void visit(const ReturnStmt &node);
+        void visit(const AssignStmt &node);
+        void visit(const VarDeclStmt &node);
+
+        void visit(const LiteralArm &node);
+        void visit(const GuardArm &node);
+        void visit(const ElseArm &node);
+
+        void visit(const FuncDef &node);
+
+        void visit_read(const Expression &node);
+
+        bool is_recursive(const std::wstring &name) const;
+        void propagate();
+
+      public:
+        EffectMap effects;
+
+        Visitor() noexcept;
+        void visit(const Expression &node) override;
+        void visit(const Statement &node) override;
+        void visit(const MatchArm &node) override;
+        void visit(const Program &node) override;
+    } visitor;
+
+  public:
+    EffectMap analyze(const Program &program);
+};
+#endif
\ No newline at end of file
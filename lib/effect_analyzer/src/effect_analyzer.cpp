@@ -0,0 +1,323 @@
+#include "effect_analyzer.hpp"
+#include <utility>
+
+FunctionEffects &FunctionEffects::operator|=(
+    const FunctionEffects &other) noexcept
+{
+    this->reads_globals |= other.reads_globals;
+    this->writes_globals |= other.writes_globals;
+    this->reads_args |= other.reads_args;
+    this->writes_args |= other.writes_args;
+    this->calls_externs |= other.calls_externs;
+    this->may_not_return |= other.may_not_return;
+    return *this;
+}
+
+EffectAnalyzer::Visitor::Visitor() noexcept
+    : current_summary(nullptr), is_written(false), is_dereferenced(false),
+      uses_ref_params(false)
+{
+}
+
+void EffectAnalyzer::Visitor::visit_read(const Expression &node)
+{
+    auto previous_is_written = std::exchange(this->is_written, false);
+    auto previous_is_dereferenced =
+        std::exchange(this->is_dereferenced, false);
+    this->visit(node);
+    this->is_written = previous_is_written;
+    this->is_dereferenced = previous_is_dereferenced;
+}
+
+void EffectAnalyzer::Visitor::visit(const VariableExpr &node)
+{
+    auto &effects = this->current_summary->effects;
+    if (this->ref_params.contains(node.name))
+    {
+        // locals aren't tracked as aliases of the parameters, so a mutable
+        // reference that's copied can be written through anywhere
+        effects.reads_args = true;
+        effects.writes_args |=
+            this->is_written || (this->mut_ref_params.contains(node.name) &&
+                                 !this->is_dereferenced);
+        this->uses_ref_params = true;
+    }
+    else if (this->mutable_globals.contains(node.name))
+    {
+        effects.reads_globals = true;
+        effects.writes_globals |= this->is_written;
+    }
+}
+
+void EffectAnalyzer::Visitor::visit(const BinaryExpr &node)
+{
+    this->visit_read(*node.lhs);
+    this->visit_read(*node.rhs);
+}
+
+void EffectAnalyzer::Visitor::visit(const UnaryExpr &node)
+{
+    switch (node.op)
+    {
+    case UnaryOpEnum::MUT_REF: {
+        // the referenced value escapes and can be written by the callee
+        auto previous_is_written = std::exchange(this->is_written, true);
+        this->visit(*node.expr);
+        this->is_written = previous_is_written;
+        break;
+    }
+    case UnaryOpEnum::DEREF: {
+        auto previous_is_dereferenced =
+            std::exchange(this->is_dereferenced, true);
+        this->visit(*node.expr);
+        this->is_dereferenced = previous_is_dereferenced;
+        break;
+    }
+
+    default:
+        this->visit_read(*node.expr);
+        break;
+    }
+}
+
+void EffectAnalyzer::Visitor::visit_call(const CallExpr &node)
+{
+    auto previous_uses_ref_params =
+        std::exchange(this->uses_ref_params, false);
+    for (const auto &arg : node.args)
+    {
+        // what the callee does through a forwarded reference is inherited
+        // from its effects
+        if (auto var = std::get_if<VariableExpr>(arg.get()))
+        {
+            auto previous_is_dereferenced =
+                std::exchange(this->is_dereferenced, true);
+            this->visit(*var);
+            this->is_dereferenced = previous_is_dereferenced;
+        }
+        else
+            this->visit_read(*arg);
+    }
+
+    if (this->externs.contains(node.callable))
+        this->current_summary->effects.calls_externs = true;
+    else
+        this->current_summary->calls.push_back(
+            Call{node.callable, this->uses_ref_params});
+    this->uses_ref_params |= previous_uses_ref_params;
+}
+
+void EffectAnalyzer::Visitor::visit(const IndexExpr &node)
+{
+    this->visit_read(*node.expr);
+    this->visit_read(*node.index_value);
+}
+
+void EffectAnalyzer::Visitor::visit(const CastExpr &node)
+{
+    this->visit_read(*node.expr);
+}
+
+void EffectAnalyzer::Visitor::visit(const Expression &node)
+{
+    std::visit(
+        overloaded{[this](const VariableExpr &node) { this->visit(node); },
+                   [this](const BinaryExpr &node) { this->visit(node); },
+                   [this](const UnaryExpr &node) { this->visit(node); },
+                   [this](const CallExpr &node) { this->visit_call(node); },
+                   [this](const IndexExpr &node) { this->visit(node); },
+                   [this](const CastExpr &node) { this->visit(node); },
+                   [](const auto &) {}},
+        node);
+}
+
+void EffectAnalyzer::Visitor::visit_block(const Block &node)
+{
+    for (const auto &stmt : node.statements)
+        this->visit(*stmt);
+}
+
+void EffectAnalyzer::Visitor::visit(const IfStmt &node)
+{
+    this->visit_read(*node.condition_expr);
+    this->visit(*node.then_block);
+    if (node.else_block)
+        this->visit(*node.else_block);
+}
+
+void EffectAnalyzer::Visitor::visit(const WhileStmt &node)
+{
+    // termination of loops isn't proven, so no `willreturn` guarantee
+    this->current_summary->effects.may_not_return = true;
+    this->visit_read(*node.condition_expr);
+    this->visit(*node.statement);
+}
+
+void EffectAnalyzer::Visitor::visit(const MatchStmt &node)
+{
+    this->visit_read(*node.matched_expr);
+    for (const auto &arm : node.match_arms)
+        this->visit(*arm);
+}
+
+void EffectAnalyzer::Visitor::visit(const ReturnStmt &node)
+{
+    if (node.expr)
+        this->visit_read(*node.expr);
+}
+
+void EffectAnalyzer::Visitor::visit(const AssignStmt &node)
+{
+    auto previous_is_written = std::exchange(this->is_written, true);
+    this->visit(*node.lhs);
+    this->is_written = previous_is_written;
+    this->visit_read(*node.rhs);
+}
+
+void EffectAnalyzer::Visitor::visit(const VarDeclStmt &node)
+{
+    if (node.initial_value)
+        this->visit_read(*node.initial_value);
+}
+
+void EffectAnalyzer::Visitor::visit(const Statement &node)
+{
+    std::visit(
+        overloaded{[this](const Block &node) { this->visit_block(node); },
+                   [this](const IfStmt &node) { this->visit(node); },
+                   [this](const WhileStmt &node) { this->visit(node); },
+                   [this](const MatchStmt &node) { this->visit(node); },
+                   [this](const ReturnStmt &node) { this->visit(node); },
+                   [this](const AssignStmt &node) { this->visit(node); },
+                   [this](const ExprStmt &node) {
+                       this->visit_read(*node.expr);
+                   },
+                   [this](const VarDeclStmt &node) { this->visit(node); },
+                   [](const BreakStmt &) {},
+                   [](const ContinueStmt &) {}},
+        node);
+}
+
+void EffectAnalyzer::Visitor::visit(const LiteralArm &node)
+{
+    for (const auto &literal : node.literals)
+        this->visit_read(*literal);
+    this->visit(*node.block);
+}
+
+void EffectAnalyzer::Visitor::visit(const GuardArm &node)
+{
+    this->visit_read(*node.condition_expr);
+    this->visit(*node.block);
+}
+
+void EffectAnalyzer::Visitor::visit(const ElseArm &node)
+{
+    this->visit(*node.block);
+}
+
+void EffectAnalyzer::Visitor::visit(const MatchArm &node)
+{
+    std::visit(
+        overloaded{[this](const LiteralArm &node) { this->visit(node); },
+                   [this](const GuardArm &node) { this->visit(node); },
+                   [this](const ElseArm &node) { this->visit(node); }},
+        node);
+}
+
+void EffectAnalyzer::Visitor::visit(const FuncDef &node)
+{
+    this->ref_params.clear();
+    this->mut_ref_params.clear();
+    for (const auto &param : node.params)
+    {
+        if (param->type.ref_spec != RefSpecifier::NON_REF)
+            this->ref_params.insert(param->name);
+        if (param->type.ref_spec == RefSpecifier::MUT_REF)
+            this->mut_ref_params.insert(param->name);
+    }
+    this->current_summary = &this->summaries[node.name];
+    this->visit_block(*node.block);
+    this->current_summary = nullptr;
+}
+
+bool EffectAnalyzer::Visitor::is_recursive(const std::wstring &name) const
+{
+    std::unordered_set<std::wstring> visited;
+    std::vector<std::wstring> pending{name};
+    while (!pending.empty())
+    {
+        auto current = std::move(pending.back());
+        pending.pop_back();
+        for (const auto &call : this->summaries.at(current).calls)
+        {
+            if (call.callee == name)
+                return true;
+            if (visited.insert(call.callee).second)
+                pending.push_back(call.callee);
+        }
+    }
+    return false;
+}
+
+// Merges the effects of callees into their callers until a fixed point is
+// reached. Arguments' memory effects are only inherited when a caller
+// forwards its own reference parameters, otherwise the callee can only touch
+// the caller's locals or globals already accounted for by `&`/`&mut`.
+void EffectAnalyzer::Visitor::propagate()
+{
+    for (auto &[name, summary] : this->summaries)
+    {
+        summary.effects.may_not_return |= this->is_recursive(name);
+        this->effects[name] = summary.effects;
+    }
+
+    auto changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (const auto &[name, summary] : this->summaries)
+        {
+            auto new_effects = summary.effects;
+            for (const auto &call : summary.calls)
+            {
+                auto callee = this->effects.at(call.callee);
+                if (!call.forwards_params)
+                    callee.reads_args = callee.writes_args = false;
+                new_effects |= callee;
+            }
+            if (new_effects != this->effects.at(name))
+            {
+                this->effects[name] = new_effects;
+                changed = true;
+            }
+        }
+    }
+}
+
+void EffectAnalyzer::Visitor::visit(const Program &node)
+{
+    this->mutable_globals.clear();
+    this->externs.clear();
+    this->summaries.clear();
+    this->effects.clear();
+
+    for (const auto &var : node.globals)
+    {
+        if (var->is_mut)
+            this->mutable_globals.insert(var->name);
+    }
+    for (const auto &ext : node.externs)
+        this->externs.insert(ext->name);
+    for (const auto &func : node.functions)
+        this->summaries[func->name];
+    for (const auto &func : node.functions)
+        this->visit(*func);
+    this->propagate();
+}
+
+EffectMap EffectAnalyzer::analyze(const Program &program)
+{
+    this->visitor.visit(program);
+    return this->visitor.effects;
+}
\ No newline at end of file
@@ -293,6 +293,7 @@ void JsonSerializer::Visitor::visit(const FuncDef &node)
     output["type"] = "FuncDef";
     output["name"] = node.name;
     output["const"] = node.is_const;
+    output["exported"] = node.is_exported;
     output["params"] = nlohmann::json::array();
     for (const auto &param : node.params)
     {
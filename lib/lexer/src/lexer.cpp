@@ -102,8 +102,9 @@ const std::map<wchar_t, CharNode> Lexer::char_nodes{
 
 Token Lexer::report_and_throw(const std::wstring &msg)
 {
-    this->report(LogLevel::ERROR, L"Lexer error at [", this->position.line,
-                 ",", this->position.column, "]: ", msg, ".");
+    this->report(LogLevel::ERROR, this->position, L"Lexer error at [",
+                 this->position.line, ",", this->position.column, "]: ", msg,
+                 ".");
     auto invalid = Token(TokenType::INVALID, this->position);
     this->get_new_char();
     return invalid;
@@ -1,11 +1,15 @@
 #ifndef __LOGGER_HPP__
 #define __LOGGER_HPP__
+#include "position.hpp"
 #include "string_builder.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -16,20 +20,54 @@ enum class LogLevel : uint8_t
     ERROR
 };
 
+// The message's text is built only when a logger asks for it, the formatter
+// holds copies of the arguments passed to `Reporter::report`.
 struct LogMessage
 {
-    std::wstring text;
     LogLevel log_level;
+    std::optional<Position> position;
+    std::function<std::wstring()> formatter;
+
+    std::wstring text() const
+    {
+        return this->formatter();
+    }
 };
 
 class Logger
 {
   protected:
     static const std::map<LogLevel, std::wstring> log_level_strings;
+    LogLevel min_level;
 
   public:
+    constexpr Logger() noexcept : Logger(LogLevel::INFO)
+    {
+    }
+
+    constexpr Logger(const LogLevel &min_level) noexcept
+        : min_level(min_level)
+    {
+    }
+
     virtual void log(const LogMessage &) noexcept = 0;
 
+    // messages below the minimal level are never passed to the logger
+    void set_min_level(const LogLevel &min_level) noexcept
+    {
+        this->min_level = min_level;
+    }
+
+    LogLevel get_min_level() const noexcept
+    {
+        return this->min_level;
+    }
+
+    bool accepts(const LogLevel &log_level) const noexcept
+    {
+        return log_level >= this->min_level;
+    }
+
     virtual ~Logger()
     {
     }
@@ -46,17 +84,20 @@ class ConsoleLogger : public Logger
     {
     }
 
+    constexpr ConsoleLogger(std::wostream &out) : out(out)
+    {
+    }
+
     void log(const LogMessage &msg) noexcept override;
 };
 
 class ExecutionLogger : public Logger
 {
     bool run;
-    LogLevel threshold;
 
   public:
     constexpr ExecutionLogger(const LogLevel &threshold)
-        : run(true), threshold(threshold)
+        : Logger(threshold), run(true)
     {
     }
 
@@ -90,14 +131,26 @@ class Reporter
   protected:
     std::unordered_set<Logger *> loggers;
 
+    // Nothing is built if no logger accepts the message's level, otherwise
+    // the arguments are copied and only formatted once a logger needs the
+    // text.
     template <typename... Args>
-    void report(const LogLevel &log_level, Args &&...data)
+    void report(const LogLevel &log_level,
+                const std::optional<Position> &position, Args &&...data)
     {
-        auto log_entry =
-            LogMessage{build_wstring(std::forward<Args>(data)...), log_level};
+        if (std::ranges::none_of(this->loggers, [&log_level](auto logger) {
+                return logger->accepts(log_level);
+            }))
+            return;
+        auto log_entry = LogMessage{
+            log_level, position,
+            [... data = std::forward<Args>(data)]() {
+                return build_wstring(data...);
+            }};
         for (const auto &logger : this->loggers)
         {
-            logger->log(log_entry);
+            if (logger->accepts(log_level))
+                logger->log(log_entry);
         }
     }
 
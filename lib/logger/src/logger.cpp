@@ -39,12 +39,11 @@ bool DebugLogger::contains_warnings() const noexcept
 
 void ExecutionLogger::log(const LogMessage &msg) noexcept
 {
-    if (msg.log_level >= this->threshold)
-        this->run = false;
+    this->run = false;
 }
 
 void ConsoleLogger::log(const LogMessage &msg) noexcept
 {
     this->out << "[" << this->log_level_strings.at(msg.log_level) << "] "
-              << msg.text << std::endl;
+              << msg.text() << std::endl;
 }
\ No newline at end of file
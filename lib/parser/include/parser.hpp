@@ -29,6 +29,7 @@ class Parser : public Reporter
 
     LexerPtr lexer;
     std::optional<Token> current_token;
+    std::size_t token_count;
 
     void next_token();
 
@@ -69,6 +70,7 @@ class Parser : public Reporter
     std::unique_ptr<Block> parse_block();
 
     std::unique_ptr<VarDeclStmt> parse_var_decl_stmt();
+    bool parse_export_attribute();
     std::unique_ptr<FuncDef> parse_func_def_stmt();
     std::unique_ptr<ExternDef> parse_extern_stmt();
 
@@ -115,11 +117,12 @@ class Parser : public Reporter
     void report_error(const std::wstring &msg);
 
   public:
-    Parser() noexcept : lexer(nullptr)
+    Parser() noexcept : lexer(nullptr), token_count(0)
     {
     }
 
-    Parser(LexerPtr lexer) noexcept : lexer(std::move(lexer))
+    Parser(LexerPtr lexer) noexcept
+        : lexer(std::move(lexer)), token_count(0)
     {
         this->next_token();
     }
@@ -134,6 +137,8 @@ class Parser : public Reporter
     LexerPtr attach_lexer(LexerPtr &lexer) noexcept;
     LexerPtr detach_lexer() noexcept;
     bool is_lexer_attached() const noexcept;
+    // comments included
+    std::size_t get_token_count() const noexcept;
 };
 
 class ParserException : public std::runtime_error
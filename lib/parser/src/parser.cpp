@@ -79,9 +79,9 @@ std::map<TokenType, std::optional<BinOpEnum>> Parser::assign_map{
 
 void Parser::report_error(const std::wstring &msg)
 {
-    this->report(LogLevel::ERROR, L"Parser error at [",
-                 this->current_token->position.line, ",",
-                 this->current_token->position.column, "]: ", msg, ".");
+    auto position = this->current_token->position;
+    this->report(LogLevel::ERROR, position, L"Parser error at [",
+                 position.line, ",", position.column, "]: ", msg, ".");
     throw ParserException();
 }
 
@@ -90,6 +90,8 @@ void Parser::next_token()
     do
     {
         this->current_token = this->lexer->get_token();
+        if (this->current_token)
+            ++this->token_count;
     } while (this->current_token == TokenType::COMMENT);
 }
 
@@ -249,13 +251,31 @@ ExprPtr Parser::parse_initial_value()
     return value;
 }
 
-// FUNC_DEF_STMT = KW_FN, [KW_CONST], FUNC_NAME_AND_PARAMS, Block;
-std::unique_ptr<FuncDef> Parser::parse_func_def_stmt()
+// ATTRIBUTE = AT, "export";
+bool Parser::parse_export_attribute()
 {
+    if (this->current_token != TokenType::AT)
+        return false;
+    this->next_token();
+    if (this->current_token != TokenType::IDENTIFIER ||
+        std::get<std::wstring>((*this->current_token).value) != L"export")
+    {
+        this->report_error(L"unknown attribute, only @export is supported");
+        return false;
+    }
+    this->next_token();
     if (this->current_token != TokenType::KW_FN)
-        return nullptr;
+        this->report_error(L"@export can only be applied to a function");
+    return true;
+}
 
+// FUNC_DEF_STMT = [ATTRIBUTE], KW_FN, [KW_CONST], FUNC_NAME_AND_PARAMS, Block;
+std::unique_ptr<FuncDef> Parser::parse_func_def_stmt()
+{
     auto position = this->current_token->position;
+    auto is_exported = this->parse_export_attribute();
+    if (this->current_token != TokenType::KW_FN)
+        return nullptr;
     this->next_token();
 
     auto is_const = false;
@@ -293,7 +313,7 @@ std::unique_ptr<FuncDef> Parser::parse_func_def_stmt()
     }
     return std::make_unique<FuncDef>(name, std::move(params),
                                      std::move(return_type), std::move(block),
-                                     is_const, position);
+                                     is_const, position, is_exported);
 }
 
 // Params = Parameter, {COMMA, Parameter}
@@ -370,7 +390,7 @@ std::optional<Type> Parser::parse_type()
     if (this->type_map.contains(this->current_token->type))
     {
         auto result =
-            Type(this->type_map[this->current_token->type], ref_spec);
+            Type(this->type_map.at(this->current_token->type), ref_spec);
         this->next_token();
         return result;
     }
@@ -1129,4 +1149,9 @@ LexerPtr Parser::detach_lexer() noexcept
 bool Parser::is_lexer_attached() const noexcept
 {
     return this->lexer != nullptr;
+}
+
+std::size_t Parser::get_token_count() const noexcept
+{
+    return this->token_count;
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#ifndef __RANGE_ANALYZER_HPP__
+#define __RANGE_ANALYZER_HPP__
+#include "visitor.hpp"
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Closed interval of values an integer expression can take, expressed in the
+// interpretation of its type (unsigned for `u32`, `char` and `bool`, signed
+// for `i32`).
+struct IntRange
+{
+    long long min, max;
+
+    bool operator==(const IntRange &) const noexcept = default;
+};
+
+struct WrapFlags
+{
+    bool no_signed_wrap, no_unsigned_wrap;
+};
+
+struct RangeFacts
+{
+    // only ranges narrower than the full range of a type are recorded
+    std::unordered_map<const AstNode *, IntRange> ranges;
+    // keyed by `BinaryExpr` and compound `AssignStmt` nodes
+    std::unordered_map<const AstNode *, WrapFlags> wrap_flags;
+};
+
+class RangeAnalyzer
+{
+    class Visitor : public ExprVisitor,
+                    public StmtVisitor,
+                    public MatchArmVisitor,
+                    public ProgramVisitor
+    {
+        using Environment = std::unordered_map<std::wstring, IntRange>;
+
+        struct Function
+        {
+            std::optional<Type> return_type;
+        };
+
+        std::unordered_map<std::wstring, Function> functions;
+        std::unordered_map<std::wstring, std::optional<Type>> types;
+        std::unordered_set<std::wstring> escaped;
+        Environment environment, globals;
+        std::unordered_map<const AstNode *, IntRange> values;
+        std::optional<Type> last_type;
+        std::optional<IntRange> last_range;
+        const Expression *matched_expr;
+
+        static std::optional<IntRange> get_type_range(
+            const std::optional<Type> &type);
+
+        void set_last(const AstNode &node, const std::optional<Type> &type,
+                      const std::optional<IntRange> &range);
+        std::optional<IntRange> find_variable(const std::wstring &name) const;
+        void assign_variable(const std::wstring &name,
+                             const std::optional<IntRange> &range);
+        void join(const Environment &other);
+        void narrow(const Expression &condition);
+        void narrow(const std::wstring &name, const BinOpEnum &op,
+                    const IntRange &bound);
+
+        std::optional<IntRange> apply(const AstNode &node, const BinOpEnum &op,
+                                      const TypeEnum &type,
+                                      const IntRange &lhs,
+                                      const IntRange &rhs);
+
+        void visit(const VariableExpr &node);
+        void visit(const BinaryExpr &node);
+        void visit(const UnaryExpr &node);
+        void visit_call(const CallExpr &node);
+        void visit(const IndexExpr &node);
+        void visit(const CastExpr &node);
+
+        void visit_block(const Block &node);
+        void visit(const IfStmt &node);
+        void visit(const WhileStmt &node);
+        void visit(const MatchStmt &node);
+        void visit(const AssignStmt &node);
+        void visit(const VarDeclStmt &node);
+
+        void visit(const LiteralArm &node);
+        void visit(const GuardArm &node);
+        void visit(const ElseArm &node);
+
+        void visit(const FuncDef &node);
+
+      public:
+        RangeFacts facts;
+
+        Visitor() noexcept;
+        void visit(const Expression &node) override;
+        void visit(const Statement &node) override;
+        void visit(const MatchArm &node) override;
+        void visit(const Program &node) override;
+    } visitor;
+
+  public:
+    RangeFacts analyze(const Program &program);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,754 @@
+#include "range_analyzer.hpp"
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace
+{
+constexpr long long i32_min = -2147483648ll;
+constexpr long long i32_max = 2147483647ll;
+constexpr long long u32_max = 4294967295ll;
+
+bool is_integer(const std::optional<Type> &type)
+{
+    if (!type || type->ref_spec != RefSpecifier::NON_REF)
+        return false;
+    switch (type->type)
+    {
+    case TypeEnum::I32:
+    case TypeEnum::U32:
+    case TypeEnum::CHAR:
+    case TypeEnum::BOOL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_unsigned(const std::optional<Type> &type)
+{
+    return is_integer(type) && type->type != TypeEnum::I32;
+}
+
+bool fits(const IntRange &range, const IntRange &bounds)
+{
+    return bounds.min <= range.min && range.max <= bounds.max;
+}
+
+const AstNode *get_node(const Expression &expr)
+{
+    return std::visit([](const AstNode &node) { return &node; }, expr);
+}
+
+IntRange unite(const IntRange &lhs, const IntRange &rhs)
+{
+    return IntRange{std::min(lhs.min, rhs.min), std::max(lhs.max, rhs.max)};
+}
+
+// Computes the mathematical (non-wrapping) range of a binary operation, if
+// it can be bounded at all.
+std::optional<IntRange> get_math_range(const BinOpEnum &op,
+                                       const TypeEnum &type,
+                                       const IntRange &lhs,
+                                       const IntRange &rhs)
+{
+    switch (op)
+    {
+    case BinOpEnum::ADD:
+        return IntRange{lhs.min + rhs.min, lhs.max + rhs.max};
+    case BinOpEnum::SUB:
+        return IntRange{lhs.min - rhs.max, lhs.max - rhs.min};
+    case BinOpEnum::MUL: {
+        std::array<long long, 4> products;
+        auto overflows = false;
+        overflows |= __builtin_mul_overflow(lhs.min, rhs.min, &products[0]);
+        overflows |= __builtin_mul_overflow(lhs.min, rhs.max, &products[1]);
+        overflows |= __builtin_mul_overflow(lhs.max, rhs.min, &products[2]);
+        overflows |= __builtin_mul_overflow(lhs.max, rhs.max, &products[3]);
+        if (overflows)
+            return std::nullopt;
+        auto [min, max] = std::ranges::minmax(products);
+        return IntRange{min, max};
+    }
+    // signed division and remainder aren't bounded, as the code generator
+    // decides on the signedness of an instruction on its own
+    case BinOpEnum::DIV:
+        if (type == TypeEnum::I32 || rhs.max == 0)
+            return std::nullopt;
+        return IntRange{lhs.min / rhs.max, lhs.max / std::max(rhs.min, 1ll)};
+    case BinOpEnum::MOD:
+        if (type == TypeEnum::I32 || rhs.max == 0)
+            return std::nullopt;
+        return IntRange{0, std::min(lhs.max, rhs.max - 1)};
+    case BinOpEnum::BIT_AND:
+        if (lhs.min < 0 || rhs.min < 0)
+            return std::nullopt;
+        return IntRange{0, std::min(lhs.max, rhs.max)};
+    // `>>` is an arithmetic shift even for unsigned values, so the ones with
+    // the top bit set are filled with ones
+    case BinOpEnum::SHR:
+        if (type == TypeEnum::I32 || rhs.max >= 32 || lhs.max > i32_max)
+            return std::nullopt;
+        return IntRange{lhs.min >> rhs.max, lhs.max >> rhs.min};
+    default:
+        return std::nullopt;
+    }
+}
+
+// Collects names of the variables that are reassigned or referenced
+// mutably inside of a statement. Assignments can only happen in statements,
+// so expressions are only scanned for `&mut`.
+struct NameCollector
+{
+    std::unordered_set<std::wstring> assigned, mut_refs;
+
+    void collect(const Expression &node)
+    {
+        std::visit(overloaded{[this](const BinaryExpr &node) {
+                                  this->collect(*node.lhs);
+                                  this->collect(*node.rhs);
+                              },
+                              [this](const UnaryExpr &node) {
+                                  if (node.op == UnaryOpEnum::MUT_REF)
+                                  {
+                                      if (auto var = std::get_if<VariableExpr>(
+                                              node.expr.get()))
+                                          this->mut_refs.insert(var->name);
+                                  }
+                                  this->collect(*node.expr);
+                              },
+                              [this](const CallExpr &node) {
+                                  for (const auto &arg : node.args)
+                                      this->collect(*arg);
+                              },
+                              [this](const IndexExpr &node) {
+                                  this->collect(*node.expr);
+                                  this->collect(*node.index_value);
+                              },
+                              [this](const CastExpr &node) {
+                                  this->collect(*node.expr);
+                              },
+                              [](const auto &) {}},
+                   node);
+    }
+
+    void collect(const Statement &node)
+    {
+        std::visit(
+            overloaded{
+                [this](const Block &node) {
+                    for (const auto &stmt : node.statements)
+                        this->collect(*stmt);
+                },
+                [this](const IfStmt &node) {
+                    this->collect(*node.condition_expr);
+                    this->collect(*node.then_block);
+                    if (node.else_block)
+                        this->collect(*node.else_block);
+                },
+                [this](const WhileStmt &node) {
+                    this->collect(*node.condition_expr);
+                    this->collect(*node.statement);
+                },
+                [this](const MatchStmt &node) {
+                    this->collect(*node.matched_expr);
+                    for (const auto &arm : node.match_arms)
+                    {
+                        std::visit(
+                            [this](const MatchArmBase &arm) {
+                                this->collect(*arm.block);
+                            },
+                            *arm);
+                        if (auto guard = std::get_if<GuardArm>(arm.get()))
+                            this->collect(*guard->condition_expr);
+                    }
+                },
+                [this](const ReturnStmt &node) {
+                    if (node.expr)
+                        this->collect(*node.expr);
+                },
+                [this](const AssignStmt &node) {
+                    if (auto var = std::get_if<VariableExpr>(node.lhs.get()))
+                        this->assigned.insert(var->name);
+                    this->collect(*node.lhs);
+                    this->collect(*node.rhs);
+                },
+                [this](const ExprStmt &node) { this->collect(*node.expr); },
+                [this](const VarDeclStmt &node) {
+                    this->assigned.insert(node.name);
+                    if (node.initial_value)
+                        this->collect(*node.initial_value);
+                },
+                [](const auto &) {}},
+            node);
+    }
+};
+} // namespace
+
+RangeAnalyzer::Visitor::Visitor() noexcept : matched_expr(nullptr)
+{
+}
+
+std::optional<IntRange> RangeAnalyzer::Visitor::get_type_range(
+    const std::optional<Type> &type)
+{
+    if (!is_integer(type))
+        return std::nullopt;
+    switch (type->type)
+    {
+    case TypeEnum::I32:
+        return IntRange{i32_min, i32_max};
+    case TypeEnum::BOOL:
+        return IntRange{0, 1};
+    // `char` values aren't limited to Unicode scalar values, see the
+    // specification
+    default:
+        return IntRange{0, u32_max};
+    }
+}
+
+void RangeAnalyzer::Visitor::set_last(const AstNode &node,
+                                      const std::optional<Type> &type,
+                                      const std::optional<IntRange> &range)
+{
+    auto type_range = get_type_range(type);
+    if (type_range && range && fits(*range, *type_range))
+        type_range = range;
+    this->last_type = type;
+    this->last_range = type_range;
+    if (this->last_range)
+        this->values.insert_or_assign(&node, *this->last_range);
+}
+
+std::optional<IntRange> RangeAnalyzer::Visitor::find_variable(
+    const std::wstring &name) const
+{
+    if (auto found = this->environment.find(name);
+        found != this->environment.end())
+        return found->second;
+    if (auto found = this->types.find(name); found != this->types.end())
+        return get_type_range(found->second);
+    return std::nullopt;
+}
+
+void RangeAnalyzer::Visitor::assign_variable(
+    const std::wstring &name, const std::optional<IntRange> &range)
+{
+    if (range && !this->escaped.contains(name))
+        this->environment.insert_or_assign(name, *range);
+    else
+        this->environment.erase(name);
+}
+
+// Merges the environment of another control flow path into the current one.
+// Variables unknown on either of the paths are forgotten.
+void RangeAnalyzer::Visitor::join(const Environment &other)
+{
+    for (auto iter = this->environment.begin();
+         iter != this->environment.end();)
+    {
+        auto found = other.find(iter->first);
+        if (found == other.end())
+            iter = this->environment.erase(iter);
+        else
+        {
+            iter->second = unite(iter->second, found->second);
+            ++iter;
+        }
+    }
+}
+
+// Narrows the ranges of variables, assuming that the given condition is
+// true. Only comparisons of unsigned values are used, as the code generator
+// doesn't yet pick the signedness of comparisons based on the operand types.
+void RangeAnalyzer::Visitor::narrow(const Expression &condition)
+{
+    auto binary = std::get_if<BinaryExpr>(&condition);
+    if (!binary)
+        return;
+    if (binary->op == BinOpEnum::AND)
+    {
+        this->narrow(*binary->lhs);
+        this->narrow(*binary->rhs);
+        return;
+    }
+
+    auto lhs_var = std::get_if<VariableExpr>(binary->lhs.get());
+    auto rhs_var = std::get_if<VariableExpr>(binary->rhs.get());
+    auto lhs_found = this->values.find(get_node(*binary->lhs));
+    auto rhs_found = this->values.find(get_node(*binary->rhs));
+    if (lhs_found == this->values.end() || rhs_found == this->values.end())
+        return;
+
+    if (lhs_var)
+        this->narrow(lhs_var->name, binary->op, rhs_found->second);
+    if (rhs_var)
+    {
+        auto flipped = binary->op;
+        switch (binary->op)
+        {
+        case BinOpEnum::LT:
+            flipped = BinOpEnum::GT;
+            break;
+        case BinOpEnum::LE:
+            flipped = BinOpEnum::GE;
+            break;
+        case BinOpEnum::GT:
+            flipped = BinOpEnum::LT;
+            break;
+        case BinOpEnum::GE:
+            flipped = BinOpEnum::LE;
+            break;
+        default:
+            break;
+        }
+        this->narrow(rhs_var->name, flipped, lhs_found->second);
+    }
+}
+
+void RangeAnalyzer::Visitor::narrow(const std::wstring &name,
+                                    const BinOpEnum &op, const IntRange &bound)
+{
+    auto type = this->types.find(name);
+    if (type == this->types.end() || !is_unsigned(type->second) ||
+        this->escaped.contains(name))
+        return;
+    auto range = *this->find_variable(name);
+    switch (op)
+    {
+    case BinOpEnum::LT:
+        range.max = std::min(range.max, bound.max - 1);
+        break;
+    case BinOpEnum::LE:
+        range.max = std::min(range.max, bound.max);
+        break;
+    case BinOpEnum::GT:
+        range.min = std::max(range.min, bound.min + 1);
+        break;
+    case BinOpEnum::GE:
+        range.min = std::max(range.min, bound.min);
+        break;
+    case BinOpEnum::EQ:
+        range.min = std::max(range.min, bound.min);
+        range.max = std::min(range.max, bound.max);
+        break;
+    default:
+        return;
+    }
+    // an empty range means that the path is dead, nothing useful to record
+    if (range.min <= range.max)
+        this->environment.insert_or_assign(name, range);
+}
+
+// Computes the range of an arithmetic operation's result and records whether
+// it is proven not to wrap in either of the interpretations of its operands.
+std::optional<IntRange> RangeAnalyzer::Visitor::apply(const AstNode &node,
+                                                      const BinOpEnum &op,
+                                                      const TypeEnum &type,
+                                                      const IntRange &lhs,
+                                                      const IntRange &rhs)
+{
+    auto type_range = *get_type_range(Type(type, RefSpecifier::NON_REF));
+    auto math_range = get_math_range(op, type, lhs, rhs);
+    if (!math_range)
+        return type_range;
+
+    if (op == BinOpEnum::ADD || op == BinOpEnum::SUB ||
+        op == BinOpEnum::MUL)
+    {
+        // operands' values are the same when reinterpreted with the other
+        // signedness
+        auto unsigned_view = [&type](const IntRange &range) {
+            return type != TypeEnum::I32 || range.min >= 0;
+        };
+        auto signed_view = [&type](const IntRange &range) {
+            return type == TypeEnum::I32 || range.max <= i32_max;
+        };
+        auto flags = WrapFlags{
+            .no_signed_wrap = signed_view(lhs) && signed_view(rhs) &&
+                              fits(*math_range, IntRange{i32_min, i32_max}),
+            .no_unsigned_wrap = unsigned_view(lhs) && unsigned_view(rhs) &&
+                                fits(*math_range, IntRange{0, u32_max})};
+        if (flags.no_signed_wrap || flags.no_unsigned_wrap)
+            this->facts.wrap_flags.insert_or_assign(&node, flags);
+    }
+
+    if (!fits(*math_range, type_range))
+        return type_range;
+    return math_range;
+}
+
+void RangeAnalyzer::Visitor::visit(const VariableExpr &node)
+{
+    auto type = this->types.find(node.name);
+    if (type == this->types.end())
+    {
+        this->set_last(node, std::nullopt, std::nullopt);
+        return;
+    }
+    auto range = this->find_variable(node.name);
+    this->set_last(node, type->second, range);
+    if (range && range != get_type_range(type->second))
+        this->facts.ranges.insert_or_assign(&node, *range);
+}
+
+void RangeAnalyzer::Visitor::visit(const BinaryExpr &node)
+{
+    this->visit(*node.lhs);
+    auto lhs_type = this->last_type;
+    auto lhs_range = this->last_range;
+    this->visit(*node.rhs);
+    auto rhs_range = this->last_range;
+
+    switch (node.op)
+    {
+    case BinOpEnum::EQ:
+    case BinOpEnum::NEQ:
+    case BinOpEnum::GT:
+    case BinOpEnum::GE:
+    case BinOpEnum::LT:
+    case BinOpEnum::LE:
+    case BinOpEnum::AND:
+    case BinOpEnum::OR:
+        this->set_last(node, Type(TypeEnum::BOOL, RefSpecifier::NON_REF),
+                       std::nullopt);
+        return;
+    default:
+        break;
+    }
+
+    std::optional<IntRange> range;
+    if (lhs_range && rhs_range && lhs_type->type != TypeEnum::BOOL)
+        range = this->apply(node, node.op, lhs_type->type, *lhs_range,
+                            *rhs_range);
+    this->set_last(node, lhs_type, range);
+}
+
+void RangeAnalyzer::Visitor::visit(const UnaryExpr &node)
+{
+    this->visit(*node.expr);
+    auto type = this->last_type;
+    auto range = this->last_range;
+    if (!type)
+    {
+        this->set_last(node, std::nullopt, std::nullopt);
+        return;
+    }
+
+    switch (node.op)
+    {
+    case UnaryOpEnum::MINUS:
+        if (type->type == TypeEnum::F64)
+        {
+            this->set_last(node, type, std::nullopt);
+            return;
+        }
+        type = Type(TypeEnum::I32, RefSpecifier::NON_REF);
+        if (range)
+            range = IntRange{-range->max, -range->min};
+        break;
+    case UnaryOpEnum::BIT_NEG:
+        if (range && type->type == TypeEnum::I32)
+            range = IntRange{-range->max - 1, -range->min - 1};
+        else if (range)
+            range = IntRange{u32_max - range->max, u32_max - range->min};
+        break;
+    case UnaryOpEnum::NEG:
+        if (range)
+            range = IntRange{1 - range->max, 1 - range->min};
+        break;
+    case UnaryOpEnum::REF:
+    case UnaryOpEnum::MUT_REF:
+        type = Type(type->type, node.op == UnaryOpEnum::REF
+                                    ? RefSpecifier::REF
+                                    : RefSpecifier::MUT_REF);
+        range = std::nullopt;
+        break;
+    case UnaryOpEnum::DEREF:
+        type = Type(type->type, RefSpecifier::NON_REF);
+        range = std::nullopt;
+        break;
+    }
+    this->set_last(node, type, range);
+}
+
+void RangeAnalyzer::Visitor::visit_call(const CallExpr &node)
+{
+    for (const auto &arg : node.args)
+        this->visit(*arg);
+    auto found = this->functions.find(node.callable);
+    if (found == this->functions.end())
+        this->set_last(node, std::nullopt, std::nullopt);
+    else
+        this->set_last(node, found->second.return_type, std::nullopt);
+}
+
+void RangeAnalyzer::Visitor::visit(const IndexExpr &node)
+{
+    this->visit(*node.expr);
+    this->visit(*node.index_value);
+    this->set_last(node, Type(TypeEnum::CHAR, RefSpecifier::NON_REF),
+                   std::nullopt);
+}
+
+void RangeAnalyzer::Visitor::visit(const CastExpr &node)
+{
+    this->visit(*node.expr);
+    // integer casts reinterpret the bits, so the range is only kept if it
+    // fits the target type, otherwise `set_last` falls back to the full range
+    this->set_last(node, node.type, this->last_range);
+}
+
+void RangeAnalyzer::Visitor::visit(const Expression &node)
+{
+    std::visit(
+        overloaded{
+            [this](const VariableExpr &node) { this->visit(node); },
+            [this](const BinaryExpr &node) { this->visit(node); },
+            [this](const UnaryExpr &node) { this->visit(node); },
+            [this](const CallExpr &node) { this->visit_call(node); },
+            [this](const IndexExpr &node) { this->visit(node); },
+            [this](const CastExpr &node) { this->visit(node); },
+            [this](const U32Expr &node) {
+                auto value = static_cast<long long>(
+                    std::min<unsigned long long>(node.value, u32_max + 1));
+                this->set_last(node,
+                               Type(TypeEnum::U32, RefSpecifier::NON_REF),
+                               IntRange{value, value});
+            },
+            [this](const F64Expr &node) {
+                this->set_last(node,
+                               Type(TypeEnum::F64, RefSpecifier::NON_REF),
+                               std::nullopt);
+            },
+            [this](const BoolExpr &node) {
+                this->set_last(node,
+                               Type(TypeEnum::BOOL, RefSpecifier::NON_REF),
+                               IntRange{node.value, node.value});
+            },
+            [this](const StringExpr &node) {
+                this->set_last(node, Type(TypeEnum::STR, RefSpecifier::REF),
+                               std::nullopt);
+            },
+            [this](const CharExpr &node) {
+                auto value = static_cast<long long>(
+                    static_cast<std::make_unsigned_t<wchar_t>>(node.value));
+                this->set_last(node,
+                               Type(TypeEnum::CHAR, RefSpecifier::NON_REF),
+                               IntRange{value, value});
+            }},
+        node);
+}
+
+void RangeAnalyzer::Visitor::visit_block(const Block &node)
+{
+    for (const auto &stmt : node.statements)
+        this->visit(*stmt);
+}
+
+void RangeAnalyzer::Visitor::visit(const IfStmt &node)
+{
+    this->visit(*node.condition_expr);
+    auto else_environment = this->environment;
+    this->narrow(*node.condition_expr);
+    this->visit(*node.then_block);
+    std::swap(this->environment, else_environment);
+    if (node.else_block)
+        this->visit(*node.else_block);
+    this->join(else_environment);
+}
+
+// Variables assigned anywhere in the loop are forgotten before the
+// condition is evaluated, so that the facts hold in every iteration without
+// the need for a fixed point.
+void RangeAnalyzer::Visitor::visit(const WhileStmt &node)
+{
+    NameCollector collector;
+    collector.collect(*node.statement);
+    for (const auto &name : collector.assigned)
+        this->environment.erase(name);
+
+    this->visit(*node.condition_expr);
+    auto exit_environment = this->environment;
+    this->narrow(*node.condition_expr);
+    this->visit(*node.statement);
+    this->environment = std::move(exit_environment);
+}
+
+void RangeAnalyzer::Visitor::visit(const MatchStmt &node)
+{
+    this->visit(*node.matched_expr);
+    auto previous_matched = std::exchange(this->matched_expr,
+                                          std::to_address(node.matched_expr));
+    // the entry environment is also the one of the path where no arm matches
+    auto entry_environment = this->environment;
+    auto exit_environment = this->environment;
+    for (const auto &arm : node.match_arms)
+    {
+        this->environment = entry_environment;
+        this->visit(*arm);
+        auto arm_environment =
+            std::exchange(this->environment, std::move(exit_environment));
+        this->join(arm_environment);
+        exit_environment = std::move(this->environment);
+    }
+    this->environment = std::move(exit_environment);
+    this->matched_expr = previous_matched;
+}
+
+void RangeAnalyzer::Visitor::visit(const AssignStmt &node)
+{
+    this->visit(*node.lhs);
+    auto type = this->last_type;
+    auto lhs_range = this->last_range;
+    this->visit(*node.rhs);
+    auto range = this->last_range;
+
+    if (node.op)
+    {
+        if (lhs_range && range && type->type != TypeEnum::BOOL)
+            range = this->apply(node, *node.op, type->type, *lhs_range,
+                                *range);
+        else
+            range = get_type_range(type);
+    }
+    if (auto var = std::get_if<VariableExpr>(node.lhs.get()))
+        this->assign_variable(var->name, range);
+}
+
+void RangeAnalyzer::Visitor::visit(const VarDeclStmt &node)
+{
+    std::optional<IntRange> range;
+    if (node.initial_value)
+    {
+        this->visit(*node.initial_value);
+        range = this->last_range;
+    }
+    this->types[node.name] = (node.type) ? (node.type) : (this->last_type);
+    this->assign_variable(node.name, range);
+}
+
+void RangeAnalyzer::Visitor::visit(const Statement &node)
+{
+    std::visit(
+        overloaded{[this](const Block &node) { this->visit_block(node); },
+                   [this](const IfStmt &node) { this->visit(node); },
+                   [this](const WhileStmt &node) { this->visit(node); },
+                   [this](const MatchStmt &node) { this->visit(node); },
+                   [this](const ReturnStmt &node) {
+                       if (node.expr)
+                           this->visit(*node.expr);
+                   },
+                   [this](const AssignStmt &node) { this->visit(node); },
+                   [this](const ExprStmt &node) { this->visit(*node.expr); },
+                   [this](const VarDeclStmt &node) { this->visit(node); },
+                   [](const BreakStmt &) {},
+                   [](const ContinueStmt &) {}},
+        node);
+}
+
+void RangeAnalyzer::Visitor::visit(const LiteralArm &node)
+{
+    std::optional<IntRange> literals_range;
+    auto is_bounded = true;
+    for (const auto &literal : node.literals)
+    {
+        this->visit(*literal);
+        if (!this->last_range)
+            is_bounded = false;
+        else if (literals_range)
+            literals_range = unite(*literals_range, *this->last_range);
+        else
+            literals_range = this->last_range;
+    }
+
+    auto var = std::get_if<VariableExpr>(this->matched_expr);
+    if (var && is_bounded && literals_range)
+    {
+        this->narrow(var->name, BinOpEnum::GE, *literals_range);
+        this->narrow(var->name, BinOpEnum::LE, *literals_range);
+    }
+    this->visit(*node.block);
+}
+
+void RangeAnalyzer::Visitor::visit(const GuardArm &node)
+{
+    this->visit(*node.condition_expr);
+    this->narrow(*node.condition_expr);
+    this->visit(*node.block);
+}
+
+void RangeAnalyzer::Visitor::visit(const ElseArm &node)
+{
+    this->visit(*node.block);
+}
+
+void RangeAnalyzer::Visitor::visit(const MatchArm &node)
+{
+    std::visit(
+        overloaded{[this](const LiteralArm &node) { this->visit(node); },
+                   [this](const GuardArm &node) { this->visit(node); },
+                   [this](const ElseArm &node) { this->visit(node); }},
+        node);
+}
+
+void RangeAnalyzer::Visitor::visit(const FuncDef &node)
+{
+    auto global_types = this->types;
+    auto global_escaped = this->escaped;
+    this->environment = this->globals;
+    this->values.clear();
+
+    // variables referenced by `&mut` can be modified by any call, so their
+    // values are never tracked
+    NameCollector collector;
+    for (const auto &stmt : node.block->statements)
+        collector.collect(*stmt);
+    this->escaped.insert(collector.mut_refs.begin(), collector.mut_refs.end());
+    for (const auto &name : collector.mut_refs)
+        this->environment.erase(name);
+
+    for (const auto &param : node.params)
+        this->types[param->name] = param->type;
+    this->visit_block(*node.block);
+
+    this->types = std::move(global_types);
+    this->escaped = std::move(global_escaped);
+}
+
+void RangeAnalyzer::Visitor::visit(const Program &node)
+{
+    this->functions.clear();
+    this->types.clear();
+    this->escaped.clear();
+    this->globals.clear();
+    this->environment.clear();
+    this->values.clear();
+    this->facts = RangeFacts();
+
+    for (const auto &ext : node.externs)
+        this->functions[ext->name] = Function{ext->return_type};
+    for (const auto &func : node.functions)
+        this->functions[func->name] = Function{func->return_type};
+
+    // immutable globals keep their initializers' values, mutable ones can be
+    // changed by any call
+    for (const auto &var : node.globals)
+    {
+        this->visit(*var);
+        if (var->is_mut)
+            this->escaped.insert(var->name);
+    }
+    this->globals = std::exchange(this->environment, Environment());
+    for (const auto &name : this->escaped)
+        this->globals.erase(name);
+
+    for (const auto &func : node.functions)
+        this->visit(*func);
+}
+
+RangeFacts RangeAnalyzer::analyze(const Program &program)
+{
+    this->visitor.visit(program);
+    return std::move(this->visitor.facts);
+}
\ No newline at end of file
@@ -9,6 +9,19 @@
 #include <unordered_map>
 #include <unordered_set>
 
+// Notified around the checking of every function, so that the driver can
+// e.g. trace the time it takes without the checker depending on LLVM.
+class CheckObserver
+{
+  public:
+    virtual void enter_function(const FuncDef &node) = 0;
+    virtual void leave_function(const FuncDef &node) = 0;
+
+    virtual ~CheckObserver()
+    {
+    }
+};
+
 class SemanticChecker
 {
     class Visitor : public ExprVisitor,
@@ -51,14 +64,39 @@ class SemanticChecker
                 this->mut = other.mut;
                 return *this;
             }
+
+            bool operator==(const VarData &) const = default;
         };
 
         struct Function
         {
             std::vector<Type> param_types;
             std::optional<Type> return_type;
+
+            bool operator==(const Function &) const = default;
+        };
+
+        // Everything a function body can observe about a top-level name.
+        struct Symbol
+        {
+            std::optional<VarData> variable;
+            std::optional<Function> function;
+
+            bool operator==(const Symbol &) const = default;
         };
 
+        // Only the diagnostics of the levels accepted by the loggers at the
+        // time are cached.
+        struct FunctionCache
+        {
+            std::unordered_map<std::wstring, Symbol> dependencies;
+            std::vector<LogMessage> diagnostics;
+            LogLevel min_level;
+        };
+
+        std::unordered_map<std::wstring, FunctionCache> function_caches;
+        std::unordered_set<std::wstring> *current_dependencies;
+
         std::vector<std::unordered_map<std::wstring, VarData>> variable_map;
         std::vector<std::unordered_map<std::wstring, Function>> function_map;
         std::deque<bool> const_scopes;
@@ -112,6 +150,13 @@ class SemanticChecker
         void visit_top_level(const FuncDef &node);
         void register_top_level(const FuncDef &node);
 
+        void add_dependency(const std::wstring &name);
+        Symbol find_top_level_symbol(const std::wstring &name) const;
+        LogLevel get_min_level() const;
+        bool is_cache_valid(const FuncDef &node) const;
+        void check_and_cache(const FuncDef &node);
+        void replay_cache(const FuncDef &node);
+
         void visit(const LiteralArm &node);
         void visit(const GuardArm &node);
         void visit(const ElseArm &node);
@@ -124,19 +169,26 @@ class SemanticChecker
         void visit(const Parameter &node) override;
         void visit(const Program &node) override;
         bool value;
+        const std::unordered_set<std::wstring> *changed_items;
+        std::unordered_set<std::wstring> checked_functions;
+        CheckObserver *observer;
     } visitor;
 
   public:
     void add_logger(Logger *logger);
     void remove_logger(Logger *logger);
+    void set_observer(CheckObserver *observer);
     void check(const Program &program);
+    void check(const Program &program,
+               const std::unordered_set<std::wstring> &changed_items);
+    const std::unordered_set<std::wstring> &get_checked_functions() const;
 };
 
 template <typename... Args>
 void SemanticChecker::Visitor::report_error(const Position &pos,
                                             Args &&...data)
 {
-    this->report(LogLevel::ERROR, "Semantic error at [", pos.line, ",",
+    this->report(LogLevel::ERROR, pos, "Semantic error at [", pos.line, ",",
                  pos.column, "]: ", data..., ".");
     this->value = false;
 }
@@ -145,8 +197,8 @@ template <typename... Args>
 void SemanticChecker::Visitor::report_warning(const Position &pos,
                                               Args &&...data)
 {
-    this->report(LogLevel::WARNING, "Semantic warning at [", pos.line, ",",
-                 pos.column, "]: ", data..., ".");
+    this->report(LogLevel::WARNING, pos, "Semantic warning at [", pos.line,
+                 ",", pos.column, "]: ", data..., ".");
 }
 
 template <typename... Args>
@@ -281,7 +281,9 @@ const std::unordered_multimap<TypeEnum, TypeEnum>
         {TypeEnum::CHAR, TypeEnum::CHAR},
 };
 
-SemanticChecker::Visitor::Visitor() noexcept : value(true)
+SemanticChecker::Visitor::Visitor() noexcept
+    : current_dependencies(nullptr), value(true), changed_items(nullptr),
+      observer(nullptr)
 {
 }
 
@@ -315,6 +317,7 @@ void SemanticChecker::Visitor::check_function_params(const FuncDef &node)
 void SemanticChecker::Visitor::check_name_shadowing(const std::wstring &name,
                                                     const Position &pos)
 {
+    this->add_dependency(name);
     for (const auto &scope : this->variable_map)
     {
         auto iter = scope.find(name);
@@ -384,6 +387,7 @@ bool SemanticChecker::Visitor::check_var_value_and_type(
 auto SemanticChecker::Visitor::find_variable(const std::wstring &name)
     -> std::optional<VarData>
 {
+    this->add_dependency(name);
     for (const auto &scope :
          std::span(this->variable_map.cbegin(), this->variable_map.cend() - 1))
     {
@@ -591,6 +595,7 @@ void SemanticChecker::Visitor::visit(const UnaryExpr &node)
 
 void SemanticChecker::Visitor::visit_call(const CallExpr &node)
 {
+    this->add_dependency(node.callable);
     if (auto func = this->find_function(node.callable))
     {
         auto expected_arg_count = func->param_types.size();
@@ -1078,6 +1083,8 @@ void SemanticChecker::Visitor::register_top_level(const FuncDef &node)
 
 void SemanticChecker::Visitor::visit_top_level(const FuncDef &node)
 {
+    if (this->observer)
+        this->observer->enter_function(node);
     this->enter_function_scope(node.is_const);
     this->register_function_params(node);
 
@@ -1094,28 +1101,163 @@ void SemanticChecker::Visitor::visit_top_level(const FuncDef &node)
             node.position,
             L"function doesn't return in each control flow path");
     }
+    if (this->observer)
+        this->observer->leave_function(node);
 }
 
+void SemanticChecker::Visitor::add_dependency(const std::wstring &name)
+{
+    if (this->current_dependencies)
+        this->current_dependencies->insert(name);
+}
+
+auto SemanticChecker::Visitor::find_top_level_symbol(
+    const std::wstring &name) const -> Symbol
+{
+    auto result = Symbol{};
+    if (auto found = this->variable_map.front().find(name);
+        found != this->variable_map.front().end())
+        result.variable = found->second;
+    if (auto found = this->function_map.front().find(name);
+        found != this->function_map.front().end())
+        result.function = found->second;
+    return result;
+}
+
+// Errors are always captured, as they decide the result of the check even
+// when no logger prints them.
+LogLevel SemanticChecker::Visitor::get_min_level() const
+{
+    auto result = LogLevel::ERROR;
+    for (const auto &logger : this->loggers)
+        result = std::min(result, logger->get_min_level());
+    return result;
+}
+
+// A cached result can be reused if the function itself didn't change and
+// every top-level name looked up in its body still resolves to the same
+// symbol - this includes names that didn't exist at the time, so that newly
+// added globals are caught by the shadowing checks. The cache also has to
+// hold every diagnostic the current loggers accept.
+bool SemanticChecker::Visitor::is_cache_valid(const FuncDef &node) const
+{
+    if (!this->changed_items || this->changed_items->contains(node.name))
+        return false;
+    auto found = this->function_caches.find(node.name);
+    if (found == this->function_caches.end() ||
+        found->second.min_level > this->get_min_level())
+        return false;
+    return std::ranges::all_of(found->second.dependencies,
+                               [this](const auto &dependency) {
+                                   return this->find_top_level_symbol(
+                                              dependency.first) ==
+                                          dependency.second;
+                               });
+}
+
+void SemanticChecker::Visitor::check_and_cache(const FuncDef &node)
+{
+    auto min_level = this->get_min_level();
+    auto capture = DebugLogger();
+    capture.set_min_level(min_level);
+    auto dependencies = std::unordered_set<std::wstring>();
+    this->add_logger(&capture);
+    this->current_dependencies = &dependencies;
+    this->visit_top_level(node);
+    this->current_dependencies = nullptr;
+    this->remove_logger(&capture);
+
+    auto &cache = this->function_caches[node.name];
+    cache.dependencies.clear();
+    for (const auto &name : dependencies)
+        cache.dependencies.emplace(name, this->find_top_level_symbol(name));
+    cache.diagnostics = capture.get_messages();
+    cache.min_level = min_level;
+    this->checked_functions.insert(node.name);
+}
+
+void SemanticChecker::Visitor::replay_cache(const FuncDef &node)
+{
+    for (const auto &msg : this->function_caches.at(node.name).diagnostics)
+    {
+        for (const auto &logger : this->loggers)
+        {
+            if (logger->accepts(msg.log_level))
+                logger->log(msg);
+        }
+        if (msg.log_level == LogLevel::ERROR)
+            this->value = false;
+    }
+}
+
+// Top-level declarations are always checked again, as they are needed to
+// rebuild the global scope. Function bodies are only checked if they
+// changed or if any of the symbols they depend on did, otherwise their
+// cached diagnostics are reported again verbatim. Checks that aren't
+// incremental neither use nor fill the caches.
 void SemanticChecker::Visitor::visit(const Program &node)
 {
+    this->value = true;
+    this->checked_functions.clear();
+    if (!this->changed_items)
+        this->function_caches.clear();
     this->enter_scope();
     for (auto &ext : node.externs)
         this->visit(*ext);
     for (auto &var : node.globals)
         this->visit(*var);
 
+    std::unordered_map<std::wstring, std::size_t> name_counts;
     for (auto &func : node.functions)
+    {
         this->register_top_level(*func);
+        ++name_counts[func->name];
+    }
     for (auto &func : node.functions)
-        this->visit_top_level(*func);
+    {
+        // caches are keyed by name, so redefined functions can't use them
+        if (!this->changed_items || name_counts.at(func->name) > 1)
+        {
+            this->function_caches.erase(func->name);
+            this->visit_top_level(*func);
+            this->checked_functions.insert(func->name);
+        }
+        else if (this->is_cache_valid(*func))
+            this->replay_cache(*func);
+        else
+            this->check_and_cache(*func);
+    }
+    std::erase_if(this->function_caches, [&name_counts](const auto &entry) {
+        return !name_counts.contains(entry.first);
+    });
     this->leave_scope();
 }
 
 void SemanticChecker::check(const Program &program)
 {
+    this->visitor.changed_items = nullptr;
     this->visitor.visit(program);
 }
 
+// Checks a new version of the program checked incrementally before, the
+// first such check checks everything. Top-level items are identified by name
+// and an item counts as changed if its source text or position changed, as
+// the cached diagnostics contain positions.
+void SemanticChecker::check(
+    const Program &program,
+    const std::unordered_set<std::wstring> &changed_items)
+{
+    this->visitor.changed_items = &changed_items;
+    this->visitor.visit(program);
+    this->visitor.changed_items = nullptr;
+}
+
+const std::unordered_set<std::wstring> &SemanticChecker::
+    get_checked_functions() const
+{
+    return this->visitor.checked_functions;
+}
+
 void SemanticChecker::add_logger(Logger *logger)
 {
     this->visitor.add_logger(logger);
@@ -1125,3 +1267,8 @@ void SemanticChecker::remove_logger(Logger *logger)
 {
     this->visitor.remove_logger(logger);
 }
+
+void SemanticChecker::set_observer(CheckObserver *observer)
+{
+    this->visitor.observer = observer;
+}
@@ -1,138 +1,621 @@
+#include "compilation_cache.hpp"
+#include "compilation_report.hpp"
+#include "compile_server.hpp"
 #include "compiled_program.hpp"
+#include "dead_code_eliminator.hpp"
 #include "json_serializer.hpp"
 #include "locale.hpp"
 #include "parser.hpp"
 #include "semantic_checker.hpp"
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Config/llvm-config.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/InitLLVM.h>
 #include <llvm/Support/MemoryBuffer.h>
-#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/Timer.h>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string_view>
 #include <system_error>
+#include <unordered_map>
+
+enum class OptLevel
+{
+    O0,
+    O1,
+    O2,
+    O3,
+    Os,
+    Oz
+};
+
+llvm::OptimizationLevel get_optimization_level(const OptLevel &level)
+{
+    switch (level)
+    {
+    case OptLevel::O1:
+        return llvm::OptimizationLevel::O1;
+    case OptLevel::O2:
+        return llvm::OptimizationLevel::O2;
+    case OptLevel::O3:
+        return llvm::OptimizationLevel::O3;
+    case OptLevel::Os:
+        return llvm::OptimizationLevel::Os;
+    case OptLevel::Oz:
+        return llvm::OptimizationLevel::Oz;
+    default:
+        return llvm::OptimizationLevel::O0;
+    }
+}
+
+using CompileFunction =
+    std::function<int(const std::string &, const std::string &,
+                      const unsigned &, std::wostream &)>;
+
+// Every file gets an object of its own named after it in the current
+// directory, like `cc -c` does. The diagnostics are buffered and printed
+// grouped by file in the order of the inputs.
+int compile_files(const std::vector<std::string> &paths,
+                  const std::string &extension, const unsigned &jobs,
+                  const CompileFunction &compile)
+{
+    auto output_paths = std::vector<std::string>();
+    auto output_inputs = std::unordered_map<std::string, std::string>();
+    for (const auto &path : paths)
+    {
+        auto output_path = std::filesystem::path(path)
+                               .filename()
+                               .replace_extension(extension)
+                               .string();
+        auto [it, inserted] = output_inputs.insert({output_path, path});
+        if (!inserted)
+        {
+            std::cerr << "The input files " << it->second << " and " << path
+                      << " would both be compiled to " << output_path << "."
+                      << std::endl;
+            return std::make_error_condition(std::errc::invalid_argument)
+                .value();
+        }
+        output_paths.push_back(output_path);
+    }
+    std::vector<std::wostringstream> diagnostics(paths.size());
+    std::vector<int> results(paths.size());
+    llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        pool.async([&, i] {
+            results[i] = compile(paths[i], output_paths[i], 1, diagnostics[i]);
+        });
+    }
+    pool.wait();
+
+    auto result = 0;
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        auto text = diagnostics[i].str();
+        if (!text.empty())
+            std::wcerr << std::filesystem::path(paths[i]).wstring() << L":\n"
+                       << text;
+        if (result == 0)
+            result = results[i];
+    }
+    return result;
+}
 
 int main(int argc, char **argv)
 {
     llvm::cl::OptionCategory mole_opts("Mole options");
-    llvm::cl::opt<std::string> input_file(llvm::cl::Positional,
-                                          llvm::cl::desc("<input file>"),
-                                          llvm::cl::init("../example.mole")
-                                          //   llvm::cl::Required
+    llvm::cl::list<std::string> input_files(llvm::cl::Positional,
+                                            llvm::cl::desc("<input files>")
+                                            //   llvm::cl::OneOrMore
     );
     llvm::cl::opt<bool> dump_ast(
         "ast-dump",
         llvm::cl::desc(
             "Dump the abstract syntax tree of the file as a JSON object."),
         llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> check_only(
+        "check-only",
+        llvm::cl::desc("Only check the program for errors, without generating "
+                       "any code."),
+        llvm::cl::init(false), llvm::cl::cat(mole_opts));
     llvm::cl::opt<bool> dump_ir("ir-dump", llvm::cl::desc("Dump the LLVM IR."),
                                 llvm::cl::init(false),
                                 llvm::cl::cat(mole_opts));
     llvm::cl::opt<bool> dump_bc(
         "bc-dump", llvm::cl::desc("Dump the LLVM bytecode."),
         llvm::cl::init(false), llvm::cl::cat(mole_opts));
-    llvm::cl::opt<bool> optimize(
-        "optimize", llvm::cl::desc("Optimize the created llvm ir."),
+    llvm::cl::opt<OptLevel> opt_level(
+        llvm::cl::desc("Optimization level:"),
+        llvm::cl::values(
+            clEnumValN(OptLevel::O0, "O0", "No optimizations (default)."),
+            clEnumValN(OptLevel::O1, "O1", "Basic optimizations."),
+            clEnumValN(OptLevel::O2, "O2", "Standard optimizations."),
+            clEnumValN(OptLevel::O3, "O3", "Aggressive optimizations."),
+            clEnumValN(OptLevel::Os, "Os", "Optimize for code size."),
+            clEnumValN(OptLevel::Oz, "Oz",
+                       "Aggressively optimize for code size.")),
+        llvm::cl::init(OptLevel::O0), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> no_warnings(
+        "w", llvm::cl::desc("Suppress all warnings."), llvm::cl::init(false),
+        llvm::cl::cat(mole_opts));
+    llvm::cl::opt<std::string> mcpu(
+        "mcpu",
+        llvm::cl::desc("Target a specific CPU, \"native\" stands for the "
+                       "host's CPU and its features."),
+        llvm::cl::value_desc("cpu-name"), llvm::cl::init("generic"),
+        llvm::cl::cat(mole_opts));
+    llvm::cl::opt<std::string> mattr(
+        "mattr",
+        llvm::cl::desc("Enable (+) or disable (-) target features, e.g. "
+                       "\"+avx2,-fma\"."),
+        llvm::cl::value_desc("a1,+a2,-a3,..."), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<std::string> target_triple(
+        "target",
+        llvm::cl::desc("Generate code for the given target triple instead "
+                       "of the host's one."),
+        llvm::cl::value_desc("triple"), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> run(
+        "run",
+        llvm::cl::desc("Execute the program in-process instead of emitting "
+                       "any output; the arguments after \"--\" are passed "
+                       "to it."),
+        llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> lazy(
+        "lazy",
+        llvm::cl::desc("Together with --run, optimize and compile each "
+                       "function only once it's first called."),
+        llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<unsigned> jit_threads(
+        "jit-threads",
+        llvm::cl::desc("Number of threads compiling the functions called by "
+                       "the already compiled ones in the background when "
+                       "running lazily."),
+        llvm::cl::value_desc("N"), llvm::cl::init(0),
+        llvm::cl::cat(mole_opts));
+    llvm::cl::opt<unsigned> jobs(
+        "j",
+        llvm::cl::desc("Number of threads compiling the input files, or "
+                       "generating the machine code of the object file if "
+                       "there's only one."),
+        llvm::cl::value_desc("N"), llvm::cl::init(1), llvm::cl::Prefix,
+        llvm::cl::cat(mole_opts));
+    llvm::cl::opt<std::string> cache_dir(
+        "cache-dir",
+        llvm::cl::desc("Reuse the outputs of earlier compilations of the same "
+                       "sources with the same options stored in the given "
+                       "directory."),
+        llvm::cl::value_desc("directory"), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<unsigned> cache_size(
+        "cache-size",
+        llvm::cl::desc("Size limit of the compilation cache in megabytes, "
+                       "1024 by default."),
+        llvm::cl::value_desc("MB"), llvm::cl::init(1024),
+        llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> incremental(
+        "incremental",
+        llvm::cl::desc("Together with --cache-dir, optimize each function on "
+                       "its own and reuse the results for the functions that "
+                       "didn't change."),
+        llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> no_server(
+        "no-server",
+        llvm::cl::desc("Compile in-process even if a compile server is "
+                       "running."),
+        llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<std::string> server_socket(
+        "server-socket",
+        llvm::cl::desc("Look for the compile server on the given Unix domain "
+                       "socket instead of the default one."),
+        llvm::cl::value_desc("path"), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> time_report(
+        "time-report",
+        llvm::cl::desc("Print the time spent in each of the compilation "
+                       "phases and optimization passes, along with the memory "
+                       "allocated in them."),
+        llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> report_json(
+        "report-json",
+        llvm::cl::desc("Print the --time-report and --stats reports as a "
+                       "single JSON object."),
+        llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> time_trace(
+        "time-trace",
+        llvm::cl::desc("Write a Chrome trace of the compilation phases, of "
+                       "the work done on every function and of LLVM's "
+                       "passes."),
         llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<std::string> time_trace_file(
+        "time-trace-file",
+        llvm::cl::desc("Write the trace to the given file instead of the "
+                       "output's name with the .time-trace extension "
+                       "appended."),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<unsigned> time_trace_granularity(
+        "time-trace-granularity",
+        llvm::cl::desc("Minimum duration of the traced events in "
+                       "microseconds, 500 by default."),
+        llvm::cl::value_desc("us"), llvm::cl::init(500),
+        llvm::cl::cat(mole_opts));
+    llvm::cl::opt<bool> debug_info(
+        "g",
+        llvm::cl::desc("Generate DWARF debug info mapping the code to the "
+                       "lines of the source, so that it can be debugged and "
+                       "profiled."),
+        llvm::cl::init(false), llvm::cl::cat(mole_opts));
+    llvm::cl::opt<std::string> profile_generate(
+        "fprofile-generate",
+        llvm::cl::desc("Instrument the program to write the profile of its "
+                       "runs to the given raw profile, default.profraw by "
+                       "default. It has to be linked with LLVM's profile "
+                       "runtime."),
+        llvm::cl::value_desc("filename"), llvm::cl::ValueOptional,
+        llvm::cl::cat(mole_opts));
+    llvm::cl::opt<std::string> profile_use(
+        "fprofile-use",
+        llvm::cl::desc("Optimize the program using the given indexed "
+                       "profile, merged from the raw ones with llvm-profdata "
+                       "merge."),
+        llvm::cl::value_desc("filename"), llvm::cl::cat(mole_opts));
     llvm::cl::opt<std::string> output_file(
         "o", llvm::cl::desc("Specify the output file."),
         llvm::cl::value_desc("filename"), llvm::cl::cat(mole_opts));
 
     llvm::InitLLVM init(argc, argv);
 
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
-
+    // LLVM registers a --stats option of its own, which would clash with a
+    // new one, so it's reused instead
+    auto &stats = *llvm::cl::getRegisteredOptions()["stats"];
+    stats.setDescription("Print statistics about the compilation, such as the "
+                         "program's size and the unused definitions removed "
+                         "before code generation.");
+    stats.addCategory(mole_opts);
+    stats.setHiddenFlag(llvm::cl::NotHidden);
     llvm::cl::HideUnrelatedOptions(mole_opts);
-    llvm::cl::ParseCommandLineOptions(argc, argv);
-
-    auto path = input_file.getValue();
-
-    auto locale = Locale("C.utf8");
-    auto logger = ConsoleLogger();
-    auto error_checker = ExecutionLogger();
+    // the program's arguments are cut off before parsing, so that they aren't
+    // taken for input files
+    auto separator = std::find(argv, argv + argc, std::string_view("--"));
+    auto run_args = std::vector<std::string>(
+        (separator == argv + argc) ? (separator) : (separator + 1),
+        argv + argc);
+    llvm::cl::ParseCommandLineOptions(separator - argv, argv);
+    // the memory allocated in each phase is measured by LLVM's timers
+    if (time_report.getValue())
+        llvm::cl::getRegisteredOptions()["track-memory"]->addOccurrence(
+            0, "track-memory", "true");
 
-    LexerPtr lexer;
-    try
+    auto paths =
+        std::vector<std::string>(input_files.begin(), input_files.end());
+    if (paths.empty())
+        paths.push_back("../example.mole");
+    if (paths.size() > 1 &&
+        (dump_ast.getValue() || run.getValue() ||
+         !output_file.getValue().empty()))
     {
-        lexer = Lexer::from_file(path);
+        std::cerr << "The --ast-dump, --run and -o options can't be used with "
+                     "multiple input files."
+                  << std::endl;
+        return std::make_error_condition(std::errc::invalid_argument).value();
     }
-    catch (const std::ios_base::failure &e)
+    if (incremental.getValue() && cache_dir.getValue().empty())
     {
-        std::cerr << e.what() << '\n';
-        return std::make_error_condition(std::errc::io_error).value();
+        std::cerr << "The --incremental option requires --cache-dir."
+                  << std::endl;
+        return std::make_error_condition(std::errc::invalid_argument).value();
     }
-
-    lexer->add_logger(&logger);
-    lexer->add_logger(&error_checker);
-
-    auto parser = Parser(std::move(lexer));
-    parser.add_logger(&logger);
-    parser.add_logger(&error_checker);
-
-    auto semantic_checker = SemanticChecker();
-    semantic_checker.add_logger(&logger);
-    semantic_checker.add_logger(&error_checker);
-
-    auto program = parser.parse();
-    if (!error_checker)
+    auto profile = ProfileOptions();
+    if (profile_generate.getNumOccurrences() > 0)
+        profile = ProfileOptions{ProfileAction::GENERATE,
+                                 profile_generate.getValue()};
+    if (!profile_use.getValue().empty())
     {
+        if (profile.action == ProfileAction::GENERATE)
+        {
+            std::cerr << "The -fprofile-generate and -fprofile-use options "
+                         "can't be used together."
+                      << std::endl;
+            return std::make_error_condition(std::errc::invalid_argument)
+                .value();
+        }
+        profile = ProfileOptions{ProfileAction::USE, profile_use.getValue()};
+    }
+    // the JIT can't link the profile runtime
+    if (profile.action == ProfileAction::GENERATE && run.getValue())
+    {
+        std::cerr << "The -fprofile-generate option can't be used with --run."
+                  << std::endl;
         return std::make_error_condition(std::errc::invalid_argument).value();
     }
-
-    semantic_checker.check(*program);
-    if (!error_checker)
+    // the functions optimized on their own or lazily don't get the profile
+    if (profile.action != ProfileAction::NONE &&
+        (incremental.getValue() || lazy.getValue()))
     {
+        std::cerr << "The profile options can't be used with --incremental or "
+                     "--lazy."
+                  << std::endl;
         return std::make_error_condition(std::errc::invalid_argument).value();
     }
+    auto extension = (dump_ir.getValue())
+                         ? (".ll")
+                         : ((dump_bc.getValue()) ? (".bc") : (".o"));
 
-    if (dump_ast.getValue())
-    {
-        auto serializer = JsonSerializer();
-        auto result = serializer.serialize(*program);
-        if (output_file.getValue() != "")
+    auto locale = Locale("C.utf8");
+
+    auto cache = std::optional<CompilationCache>();
+    if (!cache_dir.getValue().empty() && !dump_ast.getValue() &&
+        !check_only.getValue() && !run.getValue())
+        cache.emplace(cache_dir.getValue(),
+                      std::uintmax_t(cache_size.getValue()) << 20);
+    // The server only compiles files to objects, IR or bytecode, everything
+    // else is done in-process.
+    auto server = std::optional<std::filesystem::path>();
+    if (!no_server.getValue() && !cache && !dump_ast.getValue() &&
+        !check_only.getValue() && !run.getValue() &&
+        !llvm::AreStatisticsEnabled() && !time_report.getValue() &&
+        !time_trace.getValue() && profile.action == ProfileAction::NONE)
+        server = (server_socket.getValue().empty())
+                     ? (get_default_socket_path())
+                     : (std::filesystem::path(server_socket.getValue()));
+    auto output_kind = (dump_ir.getValue())
+                           ? (OutputKind::IR)
+                           : ((dump_bc.getValue()) ? (OutputKind::BYTECODE)
+                                                   : (OutputKind::OBJECT));
+    // a request is only sent if a server is running, otherwise the file is
+    // compiled in-process
+    auto send_to_server =
+        [&](const std::string &path, const std::string &output_path,
+            const unsigned &threads) -> std::optional<CompileResponse> {
+        if (!server)
+            return std::nullopt;
+        return send_request(
+            *server,
+            CompileRequest{
+                MOLE_VERSION, std::filesystem::absolute(path).string(),
+                std::filesystem::absolute(output_path).string(), output_kind,
+                get_optimization_level(opt_level.getValue()),
+                CompilationTarget{target_triple.getValue(), mcpu.getValue(),
+                                  mattr.getValue()},
+                no_warnings.getValue(), threads, debug_info.getValue()});
+    };
+    // the options shared by the keys of whole outputs and of single functions
+    auto get_target_options = [&]() {
+        auto target = resolve_target(CompilationTarget{
+            target_triple.getValue(), mcpu.getValue(), mattr.getValue()});
+        return std::vector<std::string>{MOLE_VERSION, LLVM_VERSION_STRING,
+                                        target.triple, target.cpu,
+                                        target.features};
+    };
+    // Everything besides the source that affects the output is a part of the
+    // key. The way the module is split only changes the object's layout, and
+    // incremental optimization doesn't inline across functions. The outputs
+    // refer to the source by its absolute path, in the debug info, the
+    // source file name and the names of the profiled internal functions.
+    auto get_cache_key =
+        [&](const std::string &path,
+            const unsigned &threads) -> std::optional<std::string> {
+        if (!cache)
+            return std::nullopt;
+        auto input = std::ifstream(path, std::ios::binary);
+        if (!input.good())
+            return std::nullopt;
+        auto source = std::string(std::istreambuf_iterator<char>(input), {});
+        auto options = get_target_options();
+        options.insert(
+            options.end(),
+            {std::to_string(static_cast<int>(opt_level.getValue())),
+             extension, (threads > 1) ? ("split") : ("whole"),
+             (incremental.getValue()) ? ("incremental") : ("monolithic"),
+             (debug_info.getValue()) ? ("debug") : ("no-debug"),
+             std::to_string(static_cast<int>(profile.action)), profile.path,
+             std::filesystem::absolute(path).string()});
+        // the used profile's content matters, not just its path
+        if (profile.action == ProfileAction::USE)
+        {
+            auto profile_input = std::ifstream(profile.path, std::ios::binary);
+            if (!profile_input.good())
+                return std::nullopt;
+            options.push_back(std::string(
+                std::istreambuf_iterator<char>(profile_input), {}));
+        }
+        return CompilationCache::get_key(source, options);
+    };
+
+    // LLVM is only set up once a file gets to code generation, so that
+    // checking files or sending them to the server doesn't pay for it
+    std::once_flag is_llvm_initialized;
+    // the phases are only timed with --time-report and the counts are only
+    // collected with --stats, while the time trace is enabled globally
+    auto start_phase = [&](std::optional<CompilationPhase> &phase,
+                           CompilationReport *report, const std::string &name,
+                           const std::string &description) {
+        auto timer = (report && time_report.getValue())
+                         ? (&report->get_phase_timer(name, description))
+                         : (nullptr);
+        phase.emplace(timer, description);
+    };
+    auto add_count = [&](CompilationReport *report, const std::string &name,
+                         const std::string &description,
+                         const std::uint64_t &value) {
+        if (report && llvm::AreStatisticsEnabled())
+            report->add_count(name, description, value);
+    };
+    // Everything is reported to the given stream, so that the diagnostics of
+    // files compiled concurrently don't get interleaved.
+    auto compile_file = [&](const std::string &path,
+                            const std::string &output_path,
+                            const unsigned &threads,
+                            std::wostream &diagnostics,
+                            CompilationReport *report) -> int {
+        llvm::TimeTraceScope scope("CompileFile", path);
+        // a hit skips the whole pipeline, warnings included
+        auto cache_key = get_cache_key(path, threads);
+        if (cache_key && cache->load(*cache_key, output_path))
+            return 0;
+
+        if (auto response = send_to_server(path, output_path, threads))
         {
-            std::ofstream output;
-            output.open(output_file.getValue());
-            if (!output.good())
+            diagnostics << response->diagnostics;
+            return response->status;
+        }
+
+        auto logger = ConsoleLogger(diagnostics);
+        auto error_checker = ExecutionLogger();
+        if (no_warnings.getValue())
+            logger.set_min_level(LogLevel::ERROR);
+
+        // every phase ends once the next one starts
+        auto phase = std::optional<CompilationPhase>();
+        // the lexer is driven by the parser, so they're timed together
+        start_phase(phase, report, "parsing", "Reading, lexing and parsing");
+        LexerPtr lexer;
+        try
+        {
+            lexer = Lexer::from_file(path);
+        }
+        catch (const std::ios_base::failure &e)
+        {
+            diagnostics << e.what() << '\n';
+            return std::make_error_condition(std::errc::io_error).value();
+        }
+
+        lexer->add_logger(&logger);
+        lexer->add_logger(&error_checker);
+
+        auto parser = Parser(std::move(lexer));
+        parser.add_logger(&logger);
+        parser.add_logger(&error_checker);
+
+        auto check_tracer = FunctionCheckTracer();
+        auto semantic_checker = SemanticChecker();
+        semantic_checker.add_logger(&logger);
+        semantic_checker.add_logger(&error_checker);
+        semantic_checker.set_observer(&check_tracer);
+
+        auto program = parser.parse();
+        if (!error_checker)
+        {
+            return std::make_error_condition(std::errc::invalid_argument)
+                .value();
+        }
+        add_count(report, "tokens", "Tokens read, comments included",
+                  parser.get_token_count());
+        add_count(report, "ast-nodes", "Nodes of the abstract syntax tree",
+                  count_nodes(*program));
+        add_count(report, "functions", "Functions defined",
+                  program->functions.size());
+
+        start_phase(phase, report, "semantic-checking", "Semantic checking");
+        semantic_checker.check(*program);
+        if (!error_checker)
+        {
+            return std::make_error_condition(std::errc::invalid_argument)
+                .value();
+        }
+        phase.reset();
+        if (check_only.getValue())
+            return 0;
+
+        if (dump_ast.getValue())
+        {
+            auto serializer = JsonSerializer();
+            auto result = serializer.serialize(*program);
+            if (output_file.getValue() != "")
             {
-                std::cerr << "Error while opening the output file."
-                          << std::endl;
-                return std::make_error_condition(std::errc::io_error).value();
+                std::ofstream output;
+                output.open(output_file.getValue());
+                if (!output.good())
+                {
+                    diagnostics << "Error while opening the output file."
+                                << std::endl;
+                    return std::make_error_condition(std::errc::io_error)
+                        .value();
+                }
+                output << result.dump(4) << std::endl;
+                output.close();
             }
-            output << result.dump(4) << std::endl;
-            output.close();
+            else
+                std::cout << result.dump(4) << std::endl;
+            return 0;
         }
-        else
-            std::cout << result.dump(4) << std::endl;
-        return 0;
-    }
-    else
-    {
+
+        auto stats_logger = ConsoleLogger(diagnostics);
+        auto eliminator = DeadCodeEliminator();
+        if (llvm::AreStatisticsEnabled())
+            eliminator.add_logger(&stats_logger);
+        start_phase(phase, report, "dead-code-elimination",
+                    "Dead code elimination");
+        eliminator.eliminate(*program);
+
         try
         {
-            auto compiled = CompiledProgram(*program);
-            if (optimize.getValue())
+            start_phase(phase, report, "target-initialization",
+                        "LLVM target initialization");
+            std::call_once(is_llvm_initialized, initialize_target,
+                           target_triple.getValue());
+            start_phase(phase, report, "ir-generation", "IR generation");
+            auto target = CompilationTarget{
+                target_triple.getValue(), mcpu.getValue(), mattr.getValue()};
+            // the source's path is absolute, so that debuggers find it
+            // regardless of their working directory
+            auto compiled = CompiledProgram(
+                *program, target, std::filesystem::absolute(path),
+                debug_info.getValue());
+            auto size = compiled.get_size();
+            add_count(report, "ir-functions", "IR functions generated",
+                      size.functions);
+            add_count(report, "ir-basic-blocks", "IR basic blocks generated",
+                      size.basic_blocks);
+            add_count(report, "ir-instructions", "IR instructions generated",
+                      size.instructions);
+
+            auto level = get_optimization_level(opt_level.getValue());
+            auto callbacks = llvm::PassInstrumentationCallbacks();
+            if (report && time_report.getValue())
+                report->register_callbacks(callbacks);
+            // the functions run lazily are optimized while the program runs
+            if (run.getValue() && lazy.getValue())
+                phase.reset();
+            else
+                start_phase(phase, report, "optimization", "Optimization");
+            if (run.getValue())
             {
-                compiled.optimize();
+                auto args = std::vector<std::string>{path};
+                args.insert(args.end(), run_args.begin(), run_args.end());
+                if (lazy.getValue())
+                    return compiled.execute_lazily(args, level,
+                                                   jit_threads.getValue());
+                compiled.optimize(level, &callbacks, profile);
+                phase.reset();
+                return compiled.execute(args);
             }
+            if (cache && incremental.getValue())
+                compiled.optimize_incrementally(level, *cache,
+                                                get_target_options());
+            else
+                compiled.optimize(level, &callbacks, profile);
+            size = compiled.get_size();
+            add_count(report, "optimized-basic-blocks",
+                      "IR basic blocks left after optimization",
+                      size.basic_blocks);
+            add_count(report, "optimized-instructions",
+                      "IR instructions left after optimization",
+                      size.instructions);
+
+            start_phase(phase, report, "emission", "Emission");
             std::error_code ec;
-            auto path = output_file.getValue();
-            if (path.empty())
-            {
-                if (dump_ir.getValue())
-                    path = "./out.ll";
-                else if (dump_bc.getValue())
-                    path = "./out.bc";
-                else
-                    path = "./out.o";
-            }
-            auto output = llvm::raw_fd_ostream(path, ec);
+            auto output = llvm::raw_fd_ostream(output_path, ec);
             if (ec)
             {
-                std::cerr << "Error while opening the output file."
-                          << std::endl;
+                diagnostics << "Error while opening the output file."
+                            << std::endl;
                 return std::make_error_condition(std::errc::io_error).value();
             }
             if (dump_ir.getValue())
@@ -140,14 +623,91 @@ int main(int argc, char **argv)
             else if (dump_bc.getValue())
                 compiled.output_bytecode(output);
             else
-                compiled.output_object_file(output);
+                compiled.output_object_file(output, threads);
+            output.close();
+            phase.reset();
+            if (cache_key)
+                cache->store(*cache_key, output_path);
         }
         catch (const CompilationException &e)
         {
-            std::cerr << e.what() << '\n';
+            diagnostics << e.what() << '\n';
             return std::make_error_condition(std::errc::invalid_argument)
                 .value();
         }
+        return 0;
+    };
+    // The report is printed after the file's diagnostics, even if the
+    // compilation fails. The files compiled on the pool's threads are traced
+    // separately and the traces of these threads are merged into the main
+    // thread's one once they're done.
+    auto compile = [&](const std::string &path,
+                       const std::string &output_path, const unsigned &threads,
+                       std::wostream &diagnostics) -> int {
+        auto is_thread_traced =
+            time_trace.getValue() && !llvm::timeTraceProfilerEnabled();
+        if (is_thread_traced)
+            llvm::timeTraceProfilerInitialize(
+                time_trace_granularity.getValue(), "molec");
+        auto report = std::optional<CompilationReport>();
+        if (time_report.getValue() || llvm::AreStatisticsEnabled())
+            report.emplace();
+        auto result = compile_file(path, output_path, threads, diagnostics,
+                                   (report) ? (&*report) : (nullptr));
+        if (is_thread_traced)
+            llvm::timeTraceProfilerFinishThread();
+        if (!report)
+            return result;
+
+        add_count(&*report, "peak-memory",
+                  "Peak resident memory of the compiler in bytes",
+                  get_peak_memory());
+        std::string text;
+        auto output = llvm::raw_string_ostream(text);
+        if (report_json.getValue())
+            report->print_json(output);
+        else
+            report->print(output);
+        diagnostics << output.str().c_str();
+        return result;
+    };
+
+    if (time_trace.getValue())
+        llvm::timeTraceProfilerInitialize(time_trace_granularity.getValue(),
+                                          "molec");
+    auto result = 0;
+    // the trace of multiple files is named after the compiler
+    auto trace_fallback = std::string("molec");
+    if (paths.size() == 1)
+    {
+        auto output_path = (output_file.getValue().empty())
+                               ? (std::string("./out") + extension)
+                               : (output_file.getValue());
+        trace_fallback = output_path;
+        result = compile(paths.front(), output_path, jobs.getValue(),
+                         std::wcerr);
+    }
+    else
+        result = compile_files(paths, extension, jobs.getValue(), compile);
+
+    if (time_trace.getValue())
+    {
+        if (auto error = llvm::timeTraceProfilerWrite(
+                time_trace_file.getValue(), trace_fallback))
+        {
+            std::cerr << llvm::toString(std::move(error)) << std::endl;
+            if (result == 0)
+                result =
+                    std::make_error_condition(std::errc::io_error).value();
+        }
+        llvm::timeTraceProfilerCleanup();
+    }
+
+    if (cache && llvm::AreStatisticsEnabled())
+    {
+        auto stats_logger = ConsoleLogger();
+        cache->add_logger(&stats_logger);
+        cache->report_stats();
     }
-    return 0;
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "compile_server.hpp"
+#include "locale.hpp"
+#include <iostream>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/InitLLVM.h>
+#include <llvm/Support/Signals.h>
+#include <llvm/Support/TargetSelect.h>
+#include <system_error>
+
+namespace
+{
+CompileServer *running_server = nullptr;
+} // namespace
+
+int main(int argc, char **argv)
+{
+    llvm::cl::OptionCategory molecd_opts("Mole compile server options");
+    llvm::cl::opt<std::string> socket_path(
+        "socket",
+        llvm::cl::desc("Listen on the given Unix domain socket instead of the "
+                       "default one."),
+        llvm::cl::value_desc("path"), llvm::cl::cat(molecd_opts));
+    llvm::cl::opt<unsigned> jobs(
+        "j",
+        llvm::cl::desc("Number of files compiled at the same time, all of "
+                       "the host's threads by default."),
+        llvm::cl::value_desc("N"), llvm::cl::init(0), llvm::cl::Prefix,
+        llvm::cl::cat(molecd_opts));
+
+    llvm::InitLLVM init(argc, argv);
+
+    // the clients may ask for any of the targets
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+    llvm::InitializeAllAsmPrinters();
+
+    llvm::cl::HideUnrelatedOptions(molecd_opts);
+    llvm::cl::ParseCommandLineOptions(argc, argv);
+
+    auto locale = Locale("C.utf8");
+    auto path = (socket_path.getValue().empty())
+                    ? (get_default_socket_path())
+                    : (std::filesystem::path(socket_path.getValue()));
+    try
+    {
+        auto server = CompileServer(path, MOLE_VERSION, jobs.getValue());
+        // the pending compilations are finished and the socket is removed
+        // once the server is interrupted
+        running_server = &server;
+        llvm::sys::SetInterruptFunction([] { running_server->stop(); });
+        server.serve();
+    }
+    catch (const std::system_error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return e.code().value();
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#!/bin/sh
+# usage: benchmark.sh [molec options...]
+# Compiles every program in the benchmarks directory with the given options
+# and prints the wall time of running each of them.
+
+molec="${MOLEC:-./build/molec}"
+cc="${CC:-cc}"
+
+cd "$(dirname "$0")/.." 2>/dev/null 1>&2 || return
+
+if [ ! -x "$molec" ]; then
+    echo "molec not found at $molec, set MOLEC to its path."
+    exit 1
+fi
+
+out_dir=$(mktemp -d)
+trap 'rm -rf "$out_dir"' EXIT
+
+for source in benchmarks/*.mole; do
+    name=$(basename "$source" .mole)
+    "$molec" "$@" -o "$out_dir/$name.o" "$source" || exit 1
+    "$cc" "$out_dir/$name.o" -o "$out_dir/$name" || exit 1
+    start=$(date +%s%N)
+    "$out_dir/$name" >/dev/null || exit 1
+    end=$(date +%s%N)
+    printf '%s\t%d ms\n' "$name" $(((end - start) / 1000000))
+done
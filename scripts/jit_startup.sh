@@ -0,0 +1,52 @@
+#!/bin/sh
+# usage: jit_startup.sh [molec options...]
+# Generates a module of 10000 functions of which main calls only one and
+# prints the wall time of running it with the eager and the lazy JIT. As main
+# returns right away, the time is dominated by how long it takes to reach its
+# first instruction.
+
+molec="${MOLEC:-./build/molec}"
+functions="${FUNCTIONS:-10000}"
+
+cd "$(dirname "$0")/.." 2>/dev/null 1>&2 || return
+
+if [ ! -x "$molec" ]; then
+    echo "molec not found at $molec, set MOLEC to its path."
+    exit 1
+fi
+
+out_dir=$(mktemp -d)
+trap 'rm -rf "$out_dir"' EXIT
+source="$out_dir/startup.mole"
+
+# the functions are exported, so that they aren't removed as unused
+# (they can't be called fN, as f32 and f64 are type names)
+i=0
+while [ "$i" -lt "$functions" ]; do
+    cat <<MOLE
+@export fn func$i(n: u32) => u32 {
+    let mut hash = n;
+    let mut i = 0;
+    while (i < $i % 50 + 1) {
+        hash = hash * 1103515245 + 12345;
+        i += 1;
+    }
+    return hash % 7;
+}
+MOLE
+    i=$((i + 1))
+done >"$source"
+echo "fn main() => u32 { return func0(0); }" >>"$source"
+
+time_run() {
+    name=$1
+    shift
+    start=$(date +%s%N)
+    "$molec" "$@" --run "$source" >/dev/null
+    end=$(date +%s%N)
+    printf '%s\t%d ms\n' "$name" $(((end - start) / 1000000))
+}
+
+time_run eager "$@"
+time_run lazy --lazy "$@"
+time_run lazy-threaded --lazy --jit-threads=4 "$@"
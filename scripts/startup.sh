@@ -0,0 +1,40 @@
+#!/bin/sh
+# usage: startup.sh [molec options...]
+# Compiles a trivial program in every mode of the compiler a number of times
+# and prints the average wall time of a single run, which is dominated by how
+# long it takes the compiler to start. The programs are always compiled
+# in-process, even if a compile server is running.
+
+molec="${MOLEC:-./build/molec}"
+runs="${RUNS:-20}"
+
+cd "$(dirname "$0")/.." 2>/dev/null 1>&2 || return
+
+if [ ! -x "$molec" ]; then
+    echo "molec not found at $molec, set MOLEC to its path."
+    exit 1
+fi
+
+out_dir=$(mktemp -d)
+trap 'rm -rf "$out_dir"' EXIT
+source="$out_dir/startup.mole"
+echo "fn main() => u32 { return 0; }" >"$source"
+
+time_runs() {
+    name=$1
+    shift
+    start=$(date +%s%N)
+    i=0
+    while [ "$i" -lt "$runs" ]; do
+        "$molec" --no-server "$@" -o "$out_dir/out" "$source" >/dev/null ||
+            exit 1
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    printf '%s\t%d us\n' "$name" $(((end - start) / 1000 / runs))
+}
+
+time_runs check-only --check-only "$@"
+time_runs ast-dump --ast-dump "$@"
+time_runs ir-dump --ir-dump "$@"
+time_runs object "$@"
@@ -0,0 +1,72 @@
+#include "compilation_cache.hpp"
+#include "test_files.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+TEST_CASE("Cache keys.")
+{
+    auto key = CompilationCache::get_key("fn main() {}\n", {"O2", "x86-64"});
+    SECTION("Line endings and trailing whitespace are ignored.")
+    {
+        REQUIRE(CompilationCache::get_key("fn main() {}  \r\n",
+                                          {"O2", "x86-64"}) == key);
+    }
+    SECTION("Only whitespace outside of literals is normalized.")
+    {
+        REQUIRE(CompilationCache::get_key("let a = \"b  \nc\";\n", {}) !=
+                CompilationCache::get_key("let a = \"b\nc\";\n", {}));
+        REQUIRE(CompilationCache::get_key("let a = '\\'';  \n", {}) ==
+                CompilationCache::get_key("let a = '\\'';\n", {}));
+        REQUIRE(CompilationCache::get_key("// \"\nlet a = 1;  \n", {}) ==
+                CompilationCache::get_key("// \"\nlet a = 1;\n", {}));
+    }
+    SECTION("Every part of the key matters.")
+    {
+        REQUIRE(CompilationCache::get_key("fn main() { }\n",
+                                          {"O2", "x86-64"}) != key);
+        REQUIRE(CompilationCache::get_key("fn main() {}\n",
+                                          {"O3", "x86-64"}) != key);
+        REQUIRE(CompilationCache::get_key("fn main() {}\n",
+                                          {"O2x", "86-64"}) != key);
+    }
+}
+
+TEST_CASE("Cached outputs are loaded back.")
+{
+    auto directory = TemporaryDirectory();
+    auto cache = CompilationCache(directory.path / "cache", 1024);
+    auto output = directory.path / "out.o";
+    write_file(output, "object");
+
+    REQUIRE_FALSE(cache.load("key", output));
+    cache.store("key", output);
+    fs::remove(output);
+    REQUIRE(cache.load("key", output));
+    REQUIRE(read_file(output) == "object");
+}
+
+TEST_CASE("Least recently used entries are evicted.")
+{
+    using namespace std::chrono_literals;
+    auto directory = TemporaryDirectory();
+    auto cache_path = directory.path / "cache";
+    auto cache = CompilationCache(cache_path, 25);
+    auto output = directory.path / "out.o";
+    write_file(output, "0123456789");
+
+    cache.store("first", output);
+    cache.store("second", output);
+    auto now = fs::file_time_type::clock::now();
+    fs::last_write_time(cache_path / "first", now - 3h);
+    fs::last_write_time(cache_path / "second", now - 2h);
+    REQUIRE(cache.load("first", output));
+    cache.store("third", output);
+
+    REQUIRE(fs::exists(cache_path / "first"));
+    REQUIRE_FALSE(fs::exists(cache_path / "second"));
+    REQUIRE(fs::exists(cache_path / "third"));
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "compilation_report.hpp"
+#include "compiled_program.hpp"
+#include "locale.hpp"
+#include "parser.hpp"
+#include "semantic_checker.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <string>
+
+ProgramPtr parse(const std::wstring &source)
+{
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    return parser.parse();
+}
+
+TEST_CASE("AST nodes are counted.")
+{
+    SECTION("Functions, statements and expressions.")
+    {
+        auto program = parse(L"fn main() => u32 { let x = 1 + 2; return x; }");
+        REQUIRE(count_nodes(*program) == 9);
+    }
+    SECTION("Globals, externs and parameters.")
+    {
+        auto program = parse(L"extern putchar(i32) => i32;"
+                             L"let g = 3;"
+                             L"fn f(a: u32, b: u32) {}");
+        REQUIRE(count_nodes(*program) == 8);
+    }
+    SECTION("Match arms.")
+    {
+        auto program = parse(L"fn f(a: u32) {"
+                             L"    match (a) { 1 | 2 => {} else => {} }"
+                             L"}");
+        REQUIRE(count_nodes(*program) == 12);
+    }
+}
+
+TEST_CASE("Tokens are counted.")
+{
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(L"// main\nfn main() {}"));
+    parser.parse();
+    REQUIRE(parser.get_token_count() == 7);
+}
+
+TEST_CASE("Reports are printed.")
+{
+    auto report = CompilationReport();
+    auto &timer = report.get_phase_timer("parsing", "Parsing");
+    REQUIRE(&report.get_phase_timer("parsing", "Parsing") == &timer);
+    timer.startTimer();
+    timer.stopTimer();
+    report.add_count("tokens", "Tokens read", 42);
+
+    std::string text;
+    auto output = llvm::raw_string_ostream(text);
+    SECTION("As text.")
+    {
+        report.print(output);
+        REQUIRE(output.str().find("Parsing") != std::string::npos);
+        REQUIRE(output.str().find("42 tokens - Tokens read") !=
+                std::string::npos);
+    }
+    SECTION("As JSON.")
+    {
+        report.print_json(output);
+        REQUIRE(output.str().starts_with("{\n"));
+        REQUIRE(output.str().ends_with("\n}\n"));
+        REQUIRE(output.str().find("\"time.phases.parsing.wall\": ") !=
+                std::string::npos);
+        REQUIRE(output.str().find("\"counts.tokens\": 42") !=
+                std::string::npos);
+    }
+}
+
+TEST_CASE("Optimization passes are timed.")
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto program = parse(L"fn main() => u32 {"
+                         L"    let mut result = 0;"
+                         L"    let mut i = 0;"
+                         L"    while (i < 10) { result += i; i += 1; }"
+                         L"    return result;"
+                         L"}");
+    auto compiled = CompiledProgram(*program);
+    auto size = compiled.get_size();
+    REQUIRE(size.functions == 1);
+
+    auto report = CompilationReport();
+    auto callbacks = llvm::PassInstrumentationCallbacks();
+    report.register_callbacks(callbacks);
+    compiled.optimize(llvm::OptimizationLevel::O2, &callbacks);
+    REQUIRE(compiled.get_size().instructions < size.instructions);
+
+    std::string json;
+    auto output = llvm::raw_string_ostream(json);
+    report.print_json(output);
+    REQUIRE(output.str().find("\"time.passes.InstCombinePass.wall\"") !=
+            std::string::npos);
+    // the pass managers only run the other passes
+    REQUIRE(output.str().find("PassManager") == std::string::npos);
+}
+
+TEST_CASE("Phases and functions are traced.")
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto program = parse(L"fn square(a: u32) => u32 { return a * a; }"
+                         L"fn main() => u32 { return square(6); }");
+    llvm::timeTraceProfilerInitialize(0, "compilation_report_tests");
+    {
+        auto phase = CompilationPhase(nullptr, "Semantic checking");
+        auto tracer = FunctionCheckTracer();
+        auto checker = SemanticChecker();
+        checker.set_observer(&tracer);
+        checker.check(*program);
+    }
+    {
+        auto phase = CompilationPhase(nullptr, "Optimization");
+        CompiledProgram(*program).optimize(llvm::OptimizationLevel::O2);
+    }
+    llvm::SmallString<0> trace;
+    auto output = llvm::raw_svector_ostream(trace);
+    llvm::timeTraceProfilerWrite(output);
+    llvm::timeTraceProfilerCleanup();
+
+    for (const auto &name : {"Semantic checking", "Optimization",
+                             "CheckFunction", "LowerFunction",
+                             "InstCombinePass"})
+    {
+        REQUIRE(trace.str().contains(std::string("\"name\":\"") + name +
+                                     "\""));
+    }
+    REQUIRE(trace.str().contains("\"detail\":\"square\""));
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "compile_server.hpp"
+#include "locale.hpp"
+#include "test_files.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <llvm/Support/TargetSelect.h>
+#include <string>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+// The server is stopped even if an assertion fails.
+struct RunningServer
+{
+    CompileServer server;
+    std::thread thread;
+
+    RunningServer(const fs::path &socket)
+        : server(socket, "test", 2), thread([this] { this->server.serve(); })
+    {
+    }
+
+    ~RunningServer()
+    {
+        this->server.stop();
+        this->thread.join();
+    }
+};
+
+TEST_CASE("Files are compiled by the server.")
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto directory = TemporaryDirectory();
+    auto socket = directory.path / "molecd.sock";
+    write_file(directory.path / "main.mole",
+               "fn main() => u32 { return 42; }\n");
+    write_file(directory.path / "wrong.mole",
+               "fn main() => u32 { return true; }\n");
+
+    auto server = RunningServer(socket);
+    auto request = CompileRequest{"test",
+                                  (directory.path / "main.mole").string(),
+                                  (directory.path / "main.ll").string(),
+                                  OutputKind::IR};
+
+    SECTION("Successful compilations.")
+    {
+        for (auto i = 0; i < 2; ++i)
+        {
+            auto response = send_request(socket, request);
+            REQUIRE(response);
+            REQUIRE(response->status == 0);
+            REQUIRE(response->diagnostics.empty());
+            REQUIRE(read_file(directory.path / "main.ll")
+                        .find("define i32 @main()") != std::string::npos);
+        }
+    }
+    SECTION("Errors are reported back.")
+    {
+        request.path = (directory.path / "wrong.mole").string();
+        auto response = send_request(socket, request);
+        REQUIRE(response);
+        REQUIRE(response->status != 0);
+        REQUIRE(!response->diagnostics.empty());
+    }
+    SECTION("Requests of other versions are refused.")
+    {
+        request.version = "other";
+        REQUIRE(!send_request(socket, request));
+    }
+    SECTION("The socket is private to its owner.")
+    {
+        REQUIRE(fs::status(socket).permissions() ==
+                (fs::perms::owner_read | fs::perms::owner_write));
+    }
+    SECTION("Only one server listens on a socket.")
+    {
+        REQUIRE_THROWS_AS(CompileServer(socket, "test", 1),
+                          std::system_error);
+    }
+}
+
+TEST_CASE("Nothing is sent without a server.")
+{
+    auto directory = TemporaryDirectory();
+    REQUIRE(!send_request(directory.path / "molecd.sock",
+                          CompileRequest{"test", "main.mole", "main.o"}));
+}
\ No newline at end of file
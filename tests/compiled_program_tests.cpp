@@ -0,0 +1,734 @@
+#include "compilation_cache.hpp"
+#include "compiled_program.hpp"
+#include "locale.hpp"
+#include "parser.hpp"
+#include "test_files.hpp"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/ProfileData/InstrProfWriter.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FileUtilities.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/TargetParser/Host.h>
+#include <llvm/TargetParser/Triple.h>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+
+std::string compile(const std::wstring &source,
+                    const llvm::OptimizationLevel &level,
+                    const CompilationTarget &target = CompilationTarget())
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    auto program = parser.parse();
+    auto compiled = CompiledProgram(*program, target);
+    compiled.optimize(level);
+    std::string result;
+    auto output = llvm::raw_string_ostream(result);
+    compiled.output_ir(output);
+    return output.str();
+}
+
+// The entry block of a function ends with its first terminator, as the
+// generated code never branches into the middle of a block.
+std::size_t count_allocas_outside_entry(const std::string &ir)
+{
+    auto stream = std::istringstream(ir);
+    auto in_entry = false;
+    std::size_t result = 0;
+    for (std::string line; std::getline(stream, line);)
+    {
+        if (line.starts_with("define"))
+            in_entry = true;
+        else if (line.find(" br ") != line.npos ||
+                 line.find(" ret ") != line.npos)
+            in_entry = false;
+        else if (!in_entry && line.find(" alloca ") != line.npos)
+            ++result;
+    }
+    return result;
+}
+
+const auto loop_source = std::wstring(L"fn sum(n: u32) => u32 {"
+                                      L"    let mut i = 0;"
+                                      L"    let mut total = 0;"
+                                      L"    while (i < n) {"
+                                      L"        let doubled = i * 2;"
+                                      L"        total += doubled;"
+                                      L"        i += 1;"
+                                      L"    }"
+                                      L"    return total;"
+                                      L"}"
+                                      L"fn main() { sum(100000000); }");
+
+TEST_CASE("Stack slots are allocated in the entry block.")
+{
+    SECTION("Locals declared in loops.")
+    {
+        auto ir = compile(loop_source, llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find(" alloca ") != ir.npos);
+        REQUIRE(count_allocas_outside_entry(ir) == 0);
+    }
+    SECTION("Locals declared in branches.")
+    {
+        auto ir = compile(L"fn foo(a: u32) => u32 {"
+                          L"    if (a > 1) {"
+                          L"        let b = a * 2;"
+                          L"        return b;"
+                          L"    }"
+                          L"    let c = a + 1;"
+                          L"    return c;"
+                          L"}",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(count_allocas_outside_entry(ir) == 0);
+    }
+}
+
+TEST_CASE("Optimized loops don't touch memory.")
+{
+    auto ir = compile(loop_source, llvm::OptimizationLevel::O2);
+    REQUIRE(ir.find(" alloca ") == ir.npos);
+    REQUIRE(ir.find(" load ") == ir.npos);
+    REQUIRE(ir.find(" store ") == ir.npos);
+}
+
+TEST_CASE("Optimization levels.")
+{
+    auto source = std::wstring(L"fn main() {}");
+    SECTION("Speed levels don't restrict the code size.")
+    {
+        auto ir = compile(source, llvm::OptimizationLevel::O3);
+        REQUIRE(ir.find("optsize") == ir.npos);
+        REQUIRE(ir.find("minsize") == ir.npos);
+    }
+    SECTION("Size levels mark the defined functions.")
+    {
+        auto ir = compile(source, llvm::OptimizationLevel::Os);
+        REQUIRE(ir.find("optsize") != ir.npos);
+        REQUIRE(ir.find("minsize") == ir.npos);
+        ir = compile(source, llvm::OptimizationLevel::Oz);
+        REQUIRE(ir.find("minsize") != ir.npos);
+    }
+}
+
+TEST_CASE("Target CPU and features.")
+{
+    auto source = std::wstring(L"fn main() {}");
+    SECTION("Generic CPU by default.")
+    {
+        auto ir = compile(source, llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("\"target-cpu\"=\"generic\"") != ir.npos);
+        REQUIRE(ir.find("\"target-features\"") == ir.npos);
+    }
+    SECTION("Native CPU is resolved to the host's one.")
+    {
+        auto ir = compile(source, llvm::OptimizationLevel::O0,
+                          CompilationTarget{"", "native", ""});
+        REQUIRE(ir.find("\"target-cpu\"=\"native\"") == ir.npos);
+        REQUIRE(ir.find("\"target-cpu\"=\"" +
+                        llvm::sys::getHostCPUName().str() + "\"") !=
+                ir.npos);
+    }
+    SECTION("Unknown CPUs are rejected.")
+    {
+        REQUIRE_THROWS_AS(compile(source, llvm::OptimizationLevel::O0,
+                                  CompilationTarget{"", "not-a-cpu", ""}),
+                          CompilationException);
+    }
+}
+
+TEST_CASE("Targets are initialized on demand.")
+{
+    REQUIRE_THROWS_AS(initialize_target("not-a-triple"),
+                      CompilationException);
+    initialize_target("");
+    REQUIRE(create_target_machine(CompilationTarget()));
+}
+
+TEST_CASE("Literal match arms are lowered to a switch.")
+{
+    SECTION("Literal arms and else.")
+    {
+        auto ir = compile(L"fn foo(a: u32) => u32 {"
+                          L"    let mut b = 0;"
+                          L"    match (a) {"
+                          L"        1 | 2 => { b = 10; }"
+                          L"        3 => { b = 20; }"
+                          L"        2 | 4 => { b = 30; }"
+                          L"        else => { b = 40; }"
+                          L"    }"
+                          L"    return b;"
+                          L"}",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("switch i32") != ir.npos);
+        REQUIRE(ir.find("icmp eq") == ir.npos);
+    }
+    SECTION("Arms after a guard are chained.")
+    {
+        auto ir = compile(L"fn foo(a: u32, b: bool) => u32 {"
+                          L"    match (a) {"
+                          L"        1 => { return 10; }"
+                          L"        if (b) => { return 20; }"
+                          L"        2 => { return 30; }"
+                          L"    }"
+                          L"    return 40;"
+                          L"}",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("switch i32") != ir.npos);
+        REQUIRE(ir.find("icmp eq") != ir.npos);
+    }
+    SECTION("Non-constant literals are chained.")
+    {
+        auto ir = compile(L"fn foo(a: u32, b: u32) => u32 {"
+                          L"    match (a) {"
+                          L"        b => { return 10; }"
+                          L"        2 => { return 30; }"
+                          L"    }"
+                          L"    return 40;"
+                          L"}",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("switch") == ir.npos);
+    }
+}
+
+// The right operand is evaluated only in its own block, which is skipped when
+// the left operand decides the result.
+bool is_evaluated_conditionally(const std::string &ir, const std::string &call)
+{
+    auto rhs_block = ir.find("logical_rhs:");
+    auto call_position = ir.find(call);
+    return rhs_block != ir.npos && call_position != ir.npos &&
+           rhs_block < call_position;
+}
+
+TEST_CASE("Logical operators short-circuit.")
+{
+    auto expensive = std::wstring(L"fn expensive() => bool { return true; }");
+    SECTION("And.")
+    {
+        auto ir = compile(expensive + L"fn foo(a: bool) => bool {"
+                                      L"    return a && expensive();"
+                                      L"}",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(is_evaluated_conditionally(ir, "call fastcc i1 @expensive"));
+        REQUIRE(ir.find(" phi i1 ") != ir.npos);
+    }
+    SECTION("Or.")
+    {
+        auto ir = compile(expensive + L"fn foo(a: bool) => bool {"
+                                      L"    return a || expensive();"
+                                      L"}",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(is_evaluated_conditionally(ir, "call fastcc i1 @expensive"));
+    }
+    SECTION("Compound assignments on bools.")
+    {
+        auto ir = compile(expensive + L"fn foo(a: bool) => bool {"
+                                      L"    let mut b = a;"
+                                      L"    b &= expensive();"
+                                      L"    b |= expensive();"
+                                      L"    return b;"
+                                      L"}",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(is_evaluated_conditionally(ir, "call fastcc i1 @expensive"));
+        REQUIRE(ir.find(" and i1 ") == ir.npos);
+        REQUIRE(ir.find(" or i1 ") == ir.npos);
+    }
+    SECTION("Cheap operands are selected without branching.")
+    {
+        auto ir = compile(L"fn foo(a: bool, b: u32) => bool {"
+                          L"    return a || b > 2;"
+                          L"}",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("logical_rhs") == ir.npos);
+        REQUIRE(ir.find(" select ") != ir.npos);
+    }
+}
+
+std::size_t count_occurrences(const std::string &ir, const std::string &text)
+{
+    std::size_t result = 0;
+    for (auto position = ir.find(text); position != ir.npos;
+         position = ir.find(text, position + text.size()))
+        ++result;
+    return result;
+}
+
+TEST_CASE("Integer exponentiation.")
+{
+    SECTION("Constant exponents use the shortest multiplication chain.")
+    {
+        auto ir = compile(L"fn foo(a: u32) => u32 { return a ^^ 15; }",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(count_occurrences(ir, "= mul i32") == 5);
+        REQUIRE(ir.find("call") == ir.npos);
+        ir = compile(L"fn foo(a: u32) => u32 { return a ^^ 1000; }",
+                     llvm::OptimizationLevel::O0);
+        REQUIRE(count_occurrences(ir, "= mul i32") == 14);
+    }
+    SECTION("Zero exponent.")
+    {
+        auto ir = compile(L"fn foo(a: u32) => u32 { return a ^^ 0; }",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("mul") == ir.npos);
+        REQUIRE(ir.find("ret i32 1") != ir.npos);
+    }
+    SECTION("Variable exponents inline the helper.")
+    {
+        auto ir = compile(L"fn foo(a: u32, n: u32) => u32 { return a ^^ n; }",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("__mole_ipow_u32.exit") != ir.npos);
+        REQUIRE(ir.find("call ") == ir.npos);
+        REQUIRE(ir.find("powi") == ir.npos);
+    }
+}
+
+TEST_CASE("Floating point exponentiation.")
+{
+    SECTION("Constant exponents.")
+    {
+        auto ir = compile(L"fn foo(a: f64) => f64 { return a ^^ 3; }",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("@llvm.powi.f64.i32(double %") != ir.npos);
+        REQUIRE(ir.find("lshr") == ir.npos);
+    }
+    SECTION("Variable exponents may not fit in a signed integer.")
+    {
+        auto ir = compile(L"fn foo(a: f64, n: u32) => f64 { return a ^^ n; }",
+                          llvm::OptimizationLevel::O0);
+        REQUIRE(ir.find("@llvm.powi.f64.i32") != ir.npos);
+        REQUIRE(ir.find("lshr") != ir.npos);
+        REQUIRE(ir.find("@llvm.pow.") == ir.npos);
+    }
+}
+
+TEST_CASE("String literals are pooled.")
+{
+    auto ir = compile(L"fn foo(s: &str) {}"
+                      L"fn main() {"
+                      L"    foo(\"ab\");"
+                      L"    foo(\"ab\");"
+                      L"    foo(\"ac\");"
+                      L"}",
+                      llvm::OptimizationLevel::O0);
+    REQUIRE(count_occurrences(ir, "private unnamed_addr constant [3 x i32]") ==
+            2);
+    REQUIRE(ir.find("[i32 97, i32 98, i32 0]") != ir.npos);
+    REQUIRE(ir.find("[i32 97, i32 99, i32 0]") != ir.npos);
+}
+
+TEST_CASE("Only exported functions are visible outside of the module.")
+{
+    auto ir = compile(L"fn foo() {}"
+                      L"@export fn bar() { foo(); }"
+                      L"fn main() { foo(); }",
+                      llvm::OptimizationLevel::O0);
+    REQUIRE(ir.find("define internal fastcc void @foo()") != ir.npos);
+    REQUIRE(ir.find("call fastcc void @foo()") != ir.npos);
+    REQUIRE(ir.find("define void @bar()") != ir.npos);
+    REQUIRE(ir.find("define void @main()") != ir.npos);
+}
+
+TEST_CASE("Debug info is generated when asked for.")
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(L"@export\n"
+                                             L"fn square(a: u32) => u32 {\n"
+                                             L"    let result = a * a;\n"
+                                             L"    return result;\n"
+                                             L"}"));
+    auto program = parser.parse();
+    SECTION("With debug info.")
+    {
+        auto compiled = CompiledProgram(*program, CompilationTarget(),
+                                        "/sources/square.mole", true);
+        std::string ir;
+        auto output = llvm::raw_string_ostream(ir);
+        compiled.output_ir(output);
+        REQUIRE(ir.find("filename: \"square.mole\", directory: "
+                        "\"/sources\"") != ir.npos);
+        REQUIRE(ir.find("!DISubprogram(name: \"square\"") != ir.npos);
+        REQUIRE(ir.find("!DILocalVariable(name: \"a\", arg: 1") != ir.npos);
+        REQUIRE(ir.find("!DILocalVariable(name: \"result\"") != ir.npos);
+        REQUIRE(ir.find("!DILocation(line: 3, column: 18") != ir.npos);
+        REQUIRE(ir.find("!DILocation(line: 4, column: 5") != ir.npos);
+
+        // the debug info has to survive the optimizations
+        compiled.optimize(llvm::OptimizationLevel::O2);
+        llvm::SmallString<128> path;
+        REQUIRE(!llvm::sys::fs::createTemporaryFile("mole-test", "o", path));
+        llvm::FileRemover remover(path);
+        {
+            std::error_code ec;
+            auto output = llvm::raw_fd_ostream(path, ec);
+            REQUIRE(!ec);
+            compiled.output_object_file(output);
+        }
+        auto object =
+            llvm::cantFail(llvm::object::ObjectFile::createObjectFile(path));
+        auto has_line_table = false;
+        for (const auto &section : object.getBinary()->sections())
+            has_line_table |=
+                llvm::cantFail(section.getName()) == ".debug_line";
+        REQUIRE(has_line_table);
+    }
+    SECTION("Without it.")
+    {
+        auto compiled = CompiledProgram(*program, CompilationTarget(),
+                                        "/sources/square.mole");
+        std::string ir;
+        auto output = llvm::raw_string_ostream(ir);
+        compiled.output_ir(output);
+        // the source file name is set regardless of the debug info
+        REQUIRE(ir.find("source_filename = \"/sources/square.mole\"") !=
+                ir.npos);
+        REQUIRE(ir.find("!dbg") == ir.npos);
+        REQUIRE(ir.find("llvm.dbg") == ir.npos);
+    }
+}
+
+TEST_CASE("Profile-guided optimization.")
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(
+        L"extern first(); extern second(); extern third();"
+        L"@export fn classify(a: u32) {"
+        L"    let mut i = 0;"
+        L"    while (i < a) {"
+        L"        match (i) {"
+        L"            1 => { first(); }"
+        L"            2 => { second(); }"
+        L"            3 => { third(); }"
+        L"        }"
+        L"        i += 1;"
+        L"    }"
+        L"}"));
+    auto program = parser.parse();
+    auto compiled = CompiledProgram(*program);
+    SECTION("Generating profiles.")
+    {
+        compiled.optimize(
+            llvm::OptimizationLevel::O2, nullptr,
+            ProfileOptions{ProfileAction::GENERATE, "classify.profraw"});
+        std::string ir;
+        auto output = llvm::raw_string_ostream(ir);
+        compiled.output_ir(output);
+        // the loop and the match arms get counters of their own
+        REQUIRE(ir.find("@__profc_classify = ") != ir.npos);
+        REQUIRE(ir.find("@__profc_classify = private global [1 x i64]") ==
+                ir.npos);
+        REQUIRE(ir.find("c\"classify.profraw\\00\"") != ir.npos);
+    }
+    SECTION("Using front-end profiles.")
+    {
+        auto directory = TemporaryDirectory();
+        auto path = (directory.path / "classify.profdata").string();
+        auto writer = llvm::InstrProfWriter();
+        REQUIRE(!llvm::errorToBool(writer.mergeProfileKind(
+            llvm::InstrProfKind::FrontendInstrumentation)));
+        {
+            std::error_code ec;
+            auto output = llvm::raw_fd_ostream(path, ec);
+            REQUIRE(!ec);
+            REQUIRE(!llvm::errorToBool(writer.write(output)));
+        }
+        REQUIRE_THROWS_AS(
+            compiled.optimize(llvm::OptimizationLevel::O2, nullptr,
+                              ProfileOptions{ProfileAction::USE, path}),
+            CompilationException);
+    }
+    SECTION("Using indexed profiles.")
+    {
+        // the profile has to match the hash and the number of counters of
+        // the instrumented function
+        auto instrumented = CompiledProgram(*program);
+        instrumented.optimize(
+            llvm::OptimizationLevel::O2, nullptr,
+            ProfileOptions{ProfileAction::GENERATE, "classify.profraw"});
+        std::string instrumented_ir;
+        auto instrumented_output = llvm::raw_string_ostream(instrumented_ir);
+        instrumented.output_ir(instrumented_output);
+        auto context = llvm::LLVMContext();
+        auto error = llvm::SMDiagnostic();
+        auto module =
+            llvm::parseAssemblyString(instrumented_ir, error, context);
+        REQUIRE(module);
+        auto data = module->getGlobalVariable("__profd_classify", true);
+        auto counters = module->getGlobalVariable("__profc_classify", true);
+        REQUIRE(data);
+        REQUIRE(counters);
+        auto hash = llvm::cast<llvm::ConstantInt>(
+                        data->getInitializer()->getAggregateElement(1u))
+                        ->getZExtValue();
+        auto count =
+            llvm::cast<llvm::ArrayType>(counters->getValueType())
+                ->getNumElements();
+
+        auto directory = TemporaryDirectory();
+        auto path = (directory.path / "classify.profdata").string();
+        auto writer = llvm::InstrProfWriter();
+        REQUIRE(!llvm::errorToBool(
+            writer.mergeProfileKind(llvm::InstrProfKind::IRInstrumentation)));
+        writer.addRecord(
+            llvm::NamedInstrProfRecord("classify", hash,
+                                       std::vector<std::uint64_t>(count, 100)),
+            1, [](llvm::Error error) {
+                REQUIRE(!llvm::errorToBool(std::move(error)));
+            });
+        {
+            std::error_code ec;
+            auto output = llvm::raw_fd_ostream(path, ec);
+            REQUIRE(!ec);
+            REQUIRE(!llvm::errorToBool(writer.write(output)));
+        }
+
+        compiled.optimize(llvm::OptimizationLevel::O2, nullptr,
+                          ProfileOptions{ProfileAction::USE, path});
+        std::string ir;
+        auto output = llvm::raw_string_ostream(ir);
+        compiled.output_ir(output);
+        // the loop's back edge and the match's switch are weighted
+        auto is_loop_weighted = false;
+        auto input = std::istringstream(ir);
+        for (std::string line; std::getline(input, line);)
+            is_loop_weighted |= line.find("br i1") != line.npos &&
+                                line.find("label %while_body, !prof") !=
+                                    line.npos;
+        REQUIRE(is_loop_weighted);
+        REQUIRE(ir.find("  ], !prof ") != ir.npos);
+        REQUIRE(ir.find("!{!\"function_entry_count\", i64 ") != ir.npos);
+    }
+    SECTION("Using profiles that aren't indexed.")
+    {
+        llvm::SmallString<128> path;
+        REQUIRE(!llvm::sys::fs::createTemporaryFile("mole-test", "profraw",
+                                                    path));
+        llvm::FileRemover remover(path);
+        REQUIRE_THROWS_AS(
+            compiled.optimize(
+                llvm::OptimizationLevel::O2, nullptr,
+                ProfileOptions{ProfileAction::USE, path.str().str()}),
+            CompilationException);
+        REQUIRE_THROWS_AS(
+            compiled.optimize(llvm::OptimizationLevel::O2, nullptr,
+                              ProfileOptions{ProfileAction::USE,
+                                             path.str().str() + ".missing"}),
+            CompilationException);
+    }
+}
+
+int run(const std::wstring &source)
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    auto program = parser.parse();
+    auto compiled = CompiledProgram(*program);
+    compiled.optimize(llvm::OptimizationLevel::O1);
+    return compiled.execute({"test"});
+}
+
+TEST_CASE("Programs are executed in-process.")
+{
+    SECTION("The result of main is returned.")
+    {
+        REQUIRE(run(L"fn square(a: u32) => u32 { return a * a; }"
+                    L"fn main() => u32 { return square(6) + 6; }") == 42);
+        REQUIRE(run(L"fn main() {}") == 0);
+    }
+    SECTION("Externs are resolved against the host process.")
+    {
+        REQUIRE(run(L"extern abs(i32) => i32;"
+                    L"fn main() => u32 { return abs(-5) as u32; }") == 5);
+    }
+    SECTION("Programs without main can't be executed.")
+    {
+        REQUIRE_THROWS_AS(run(L"@export fn foo() {}"), CompilationException);
+    }
+}
+
+int run_lazily(const std::wstring &source, const unsigned &threads)
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    auto program = parser.parse();
+    auto compiled = CompiledProgram(*program);
+    return compiled.execute_lazily({"test"}, llvm::OptimizationLevel::O2,
+                                   threads);
+}
+
+TEST_CASE("Programs are executed lazily.")
+{
+    auto source = L"fn unused(a: u32) => u32 { return a / 3; }"
+                  L"fn square(a: u32) => u32 { return a * a; }"
+                  L"fn add_square(a: u32, b: u32) => u32"
+                  L"{ return a + square(b); }"
+                  L"fn main() => u32 { return add_square(6, 6); }";
+    SECTION("Without compile threads.")
+    {
+        REQUIRE(run_lazily(source, 0) == 42);
+    }
+    SECTION("With compile threads.")
+    {
+        REQUIRE(run_lazily(source, 2) == 42);
+    }
+    SECTION("Externs are resolved against the host process.")
+    {
+        REQUIRE(run_lazily(L"extern abs(i32) => i32;"
+                           L"fn main() => u32 { return abs(-5) as u32; }",
+                           2) == 5);
+    }
+}
+
+std::unordered_set<std::string> get_lazily_compiled(
+    const std::wstring &source, const unsigned &threads)
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    auto program = parser.parse();
+    auto compiled = CompiledProgram(*program);
+    compiled.execute_lazily({"test"}, llvm::OptimizationLevel::O2, threads);
+    return compiled.get_compiled_functions();
+}
+
+TEST_CASE("Callees are compiled ahead of their first call.")
+{
+    auto source = L"extern rand() => i32;"
+                  L"fn never() => u32 { return 7; }"
+                  L"fn main() => u32 {"
+                  L"    if (rand() == -1) { return never(); }"
+                  L"    return 42;"
+                  L"}";
+    SECTION("With compile threads.")
+    {
+        auto compiled = get_lazily_compiled(source, 2);
+        REQUIRE(compiled.contains("main"));
+        REQUIRE(compiled.contains("never"));
+    }
+    SECTION("Without compile threads.")
+    {
+        auto compiled = get_lazily_compiled(source, 0);
+        REQUIRE(compiled.contains("main"));
+        REQUIRE(!compiled.contains("never"));
+    }
+}
+
+// Returns the names of the symbols the object defines, or nothing if it has
+// any undefined ones.
+std::vector<std::string>
+get_defined_symbols(const std::wstring &source, const unsigned &threads,
+                    const CompilationTarget &target = CompilationTarget())
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    auto program = parser.parse();
+    auto compiled = CompiledProgram(*program, target);
+    compiled.optimize(llvm::OptimizationLevel::O2);
+
+    llvm::SmallString<128> path;
+    REQUIRE(!llvm::sys::fs::createTemporaryFile("mole-test", "o", path));
+    llvm::FileRemover remover(path);
+    {
+        std::error_code ec;
+        auto output = llvm::raw_fd_ostream(path, ec);
+        REQUIRE(!ec);
+        compiled.output_object_file(output, threads);
+    }
+
+    auto object =
+        llvm::cantFail(llvm::object::ObjectFile::createObjectFile(path));
+    std::vector<std::string> result;
+    for (const auto &symbol : object.getBinary()->symbols())
+    {
+        auto flags = llvm::cantFail(symbol.getFlags());
+        if (flags & llvm::object::SymbolRef::SF_Undefined)
+            return {};
+        result.push_back(llvm::cantFail(symbol.getName()).str());
+    }
+    return result;
+}
+
+TEST_CASE("Object files are emitted in parallel.")
+{
+    auto source = L"fn helper(a: u32) => u32 { return a * 3 + 1; }"
+                  L"@export fn first(a: u32) => u32"
+                  L"{ return helper(a) + 1; }"
+                  L"@export fn second(a: u32) => u32"
+                  L"{ return helper(a) + 2; }"
+                  L"@export fn third(a: u32) => u32"
+                  L"{ return helper(a) + 3; }"
+                  L"fn main() => u32 { return first(1) + third(2); }";
+    for (auto threads : {1u, 4u})
+    {
+        auto symbols = get_defined_symbols(source, threads);
+        for (auto name : {"main", "first", "second", "third"})
+            REQUIRE(std::ranges::find(symbols, name) != symbols.end());
+    }
+    // the host's `ld` can't merge the partitions of other operating systems
+    auto triple = llvm::Triple(llvm::sys::getDefaultTargetTriple());
+    triple.setOSAndEnvironmentName((triple.isOSWindows()) ? ("linux-gnu")
+                                                          : ("windows-msvc"));
+    auto target = CompilationTarget();
+    target.triple = triple.str();
+    auto symbols = get_defined_symbols(source, 4, target);
+    for (auto name : {"main", "first", "second", "third"})
+        REQUIRE(std::ranges::find(symbols, name) != symbols.end());
+}
+
+int run_incrementally(const std::wstring &source, CompilationCache &cache)
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    auto program = parser.parse();
+    auto compiled = CompiledProgram(*program);
+    compiled.optimize_incrementally(llvm::OptimizationLevel::O2, cache, {});
+    return compiled.execute({"test"});
+}
+
+TEST_CASE("Functions are optimized incrementally.")
+{
+    auto directory = TemporaryDirectory();
+    auto source = std::wstring(L"let mut calls = 0;"
+                               L"fn square(a: u32) => u32"
+                               L"{ calls += 1; return a * a; }"
+                               L"fn add_square(a: u32, b: u32) => u32"
+                               L"{ return a + square(b); }"
+                               L"fn main() => u32"
+                               L"{ return add_square(5, 6) + calls; }");
+
+    auto first = CompilationCache(directory.path, 1 << 20);
+    REQUIRE(run_incrementally(source, first) == 42);
+    REQUIRE(first.get_hits() == 0);
+    REQUIRE(first.get_misses() == 3);
+
+    auto second = CompilationCache(directory.path, 1 << 20);
+    REQUIRE(run_incrementally(source, second) == 42);
+    REQUIRE(second.get_hits() == 3);
+
+    auto changed = source;
+    changed.replace(changed.find(L"a * a"), 5, L"a * 2");
+    auto third = CompilationCache(directory.path, 1 << 20);
+    REQUIRE(run_incrementally(changed, third) == 18);
+    REQUIRE(third.get_hits() == 2);
+    REQUIRE(third.get_misses() == 1);
+}
\ No newline at end of file
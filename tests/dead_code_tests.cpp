@@ -0,0 +1,84 @@
+#include "dead_code_eliminator.hpp"
+#include "locale.hpp"
+#include "parser.hpp"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+ProgramPtr parse(const std::wstring &source)
+{
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    return parser.parse();
+}
+
+template <typename Item>
+bool contains(const std::vector<std::unique_ptr<Item>> &items,
+              const std::wstring &name)
+{
+    return std::ranges::any_of(
+        items, [&name](const auto &item) { return item->name == name; });
+}
+
+TEST_CASE("Items unreachable from main are removed.")
+{
+    auto program = parse(L"extern getchar() => i32;"
+                         L"extern putchar(i32) => i32;"
+                         L"let used = 3;"
+                         L"let unused = 4;"
+                         L"fn helper() => u32 { return used; }"
+                         L"fn unused_helper() { putchar(unused as i32); }"
+                         L"fn main() { getchar(); helper(); }");
+    auto stats = DeadCodeEliminator().eliminate(*program);
+    REQUIRE(stats.functions == 1);
+    REQUIRE(stats.globals == 1);
+    REQUIRE(stats.externs == 1);
+    REQUIRE(contains(program->functions, L"main"));
+    REQUIRE(contains(program->functions, L"helper"));
+    REQUIRE_FALSE(contains(program->functions, L"unused_helper"));
+    REQUIRE(contains(program->globals, L"used"));
+    REQUIRE_FALSE(contains(program->globals, L"unused"));
+    REQUIRE(contains(program->externs, L"getchar"));
+    REQUIRE_FALSE(contains(program->externs, L"putchar"));
+}
+
+TEST_CASE("Reachability is transitive.")
+{
+    auto program = parse(L"let mut counter = 0;"
+                         L"fn baz() { counter += 1; }"
+                         L"fn bar() { match (counter) { 1 => baz(); } }"
+                         L"fn foo() { while (true) { bar(); } }"
+                         L"fn recursive() { recursive(); }"
+                         L"fn main() { foo(); }");
+    auto stats = DeadCodeEliminator().eliminate(*program);
+    REQUIRE(stats.functions == 1);
+    REQUIRE(stats.globals == 0);
+    REQUIRE_FALSE(contains(program->functions, L"recursive"));
+}
+
+TEST_CASE("Exported functions are roots.")
+{
+    auto program = parse(L"let unused = 4;"
+                         L"fn foo() => u32 { return 1; }"
+                         L"@export fn bar() { foo(); }"
+                         L"fn baz() {}");
+    auto stats = DeadCodeEliminator().eliminate(*program);
+    REQUIRE(stats.functions == 1);
+    REQUIRE(stats.globals == 1);
+    REQUIRE(contains(program->functions, L"foo"));
+    REQUIRE(contains(program->functions, L"bar"));
+    REQUIRE_FALSE(contains(program->functions, L"baz"));
+}
+
+TEST_CASE("Removed items are reported.")
+{
+    auto program = parse(L"fn foo() {}"
+                         L"fn main() {}");
+    auto logger = DebugLogger();
+    auto eliminator = DeadCodeEliminator();
+    eliminator.add_logger(&logger);
+    eliminator.eliminate(*program);
+    REQUIRE(logger.get_messages().size() == 1);
+    REQUIRE(logger.get_messages()[0].log_level == LogLevel::INFO);
+    REQUIRE_FALSE(logger.contains_errors());
+}
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "effect_analyzer.hpp"
+#include "locale.hpp"
+#include "parser.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <string>
+
+FunctionEffects get_effects(const std::wstring &source,
+                            const std::wstring &function)
+{
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    auto program = parser.parse();
+    auto analyzer = EffectAnalyzer();
+    return analyzer.analyze(*program).at(function);
+}
+
+bool is_pure(const FunctionEffects &effects)
+{
+    return effects == FunctionEffects{};
+}
+
+TEST_CASE("Functions without outside access are pure.")
+{
+    REQUIRE(is_pure(get_effects(L"fn foo(a: u32, b: u32) => u32 {"
+                                L"    let c = a + b;"
+                                L"    return c * 2;"
+                                L"}",
+                                L"foo")));
+    REQUIRE(is_pure(get_effects(L"let value = 3;"
+                                L"fn foo() => u32 {"
+                                L"    return value;"
+                                L"}",
+                                L"foo")));
+}
+
+TEST_CASE("Global accesses.")
+{
+    SECTION("Reading a mutable global.")
+    {
+        auto effects = get_effects(L"let mut value = 3;"
+                                   L"fn foo() => u32 {"
+                                   L"    return value;"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(effects.reads_globals);
+        REQUIRE_FALSE(effects.writes_globals);
+    }
+    SECTION("Writing a mutable global.")
+    {
+        auto effects = get_effects(L"let mut value = 3;"
+                                   L"fn foo() {"
+                                   L"    value = 4;"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(effects.writes_globals);
+    }
+    SECTION("Mutable reference to a global escapes.")
+    {
+        auto effects = get_effects(L"let mut value = 3;"
+                                   L"fn bar(a: &mut u32) {}"
+                                   L"fn foo() {"
+                                   L"    bar(&mut value);"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(effects.writes_globals);
+    }
+}
+
+TEST_CASE("Reference parameters.")
+{
+    SECTION("Reading through a reference.")
+    {
+        auto effects = get_effects(L"fn foo(a: &u32) => u32 {"
+                                   L"    return *a;"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(effects.reads_args);
+        REQUIRE_FALSE(effects.writes_args);
+        REQUIRE_FALSE(effects.reads_globals);
+    }
+    SECTION("Writing through a mutable reference.")
+    {
+        auto effects = get_effects(L"fn foo(a: &mut u32) {"
+                                   L"    *a = 3;"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(effects.writes_args);
+    }
+    SECTION("Writing through a copied mutable reference.")
+    {
+        auto effects = get_effects(L"fn foo(p: &mut u32) {"
+                                   L"    let r = p;"
+                                   L"    *r = 1;"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(effects.reads_args);
+        REQUIRE(effects.writes_args);
+    }
+    SECTION("Callee writes to caller's locals only.")
+    {
+        auto effects = get_effects(L"fn bar(a: &mut u32) {"
+                                   L"    *a = 3;"
+                                   L"}"
+                                   L"fn foo() {"
+                                   L"    let mut b = 2;"
+                                   L"    bar(&mut b);"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(is_pure(effects));
+    }
+    SECTION("Forwarded reference is written by the callee.")
+    {
+        auto effects = get_effects(L"fn bar(a: &mut u32) {"
+                                   L"    *a = 3;"
+                                   L"}"
+                                   L"fn foo(a: &mut u32) {"
+                                   L"    bar(a);"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(effects.writes_args);
+    }
+    SECTION("Forwarded reference is only read by the callee.")
+    {
+        auto effects = get_effects(L"fn bar(a: &mut u32) => u32 {"
+                                   L"    return *a;"
+                                   L"}"
+                                   L"fn foo(a: &mut u32) => u32 {"
+                                   L"    return bar(a);"
+                                   L"}",
+                                   L"foo");
+        REQUIRE(effects.reads_args);
+        REQUIRE_FALSE(effects.writes_args);
+    }
+}
+
+TEST_CASE("Effects propagate through the call graph.")
+{
+    SECTION("Transitive global writes and externs.")
+    {
+        auto source = L"extern getchar() => i32;"
+                      L"let mut value = 3;"
+                      L"fn baz() { value = 1; getchar(); }"
+                      L"fn bar() { baz(); }"
+                      L"fn foo() { bar(); }";
+        auto effects = get_effects(source, L"foo");
+        REQUIRE(effects.writes_globals);
+        REQUIRE(effects.calls_externs);
+    }
+    SECTION("Loops and recursion may not return.")
+    {
+        REQUIRE(get_effects(L"fn foo() { while (true) {} }", L"foo")
+                    .may_not_return);
+        REQUIRE(get_effects(L"fn bar() { foo(); }"
+                            L"fn foo() { bar(); }",
+                            L"foo")
+                    .may_not_return);
+        REQUIRE(get_effects(L"fn bar() { bar(); }"
+                            L"fn foo() { bar(); }",
+                            L"foo")
+                    .may_not_return);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "logger.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <sstream>
+#include <string>
+
+struct FormatCounter
+{
+    int *count;
+};
+
+std::wostream &operator<<(std::wostream &os, const FormatCounter &counter)
+{
+    ++*counter.count;
+    return os << L"counted";
+}
+
+class TestReporter : public Reporter
+{
+  public:
+    template <typename... Args>
+    void log(const LogLevel &log_level, Args &&...data)
+    {
+        this->report(log_level, Position(1, 2), std::forward<Args>(data)...);
+    }
+};
+
+TEST_CASE("Messages are only formatted when rendered.")
+{
+    auto format_count = 0;
+    auto reporter = TestReporter();
+    auto logger = DebugLogger();
+    logger.set_min_level(LogLevel::WARNING);
+    reporter.add_logger(&logger);
+
+    SECTION("Messages below the minimal level are dropped.")
+    {
+        reporter.log(LogLevel::INFO, FormatCounter{&format_count});
+        REQUIRE(logger.get_messages().empty());
+        REQUIRE(format_count == 0);
+    }
+    SECTION("Accepted messages are formatted lazily.")
+    {
+        reporter.log(LogLevel::WARNING, L"value: ",
+                     FormatCounter{&format_count});
+        REQUIRE(logger.get_messages().size() == 1);
+        REQUIRE(format_count == 0);
+
+        auto &msg = logger.get_messages().front();
+        REQUIRE(msg.text() == L"value: counted");
+        REQUIRE(format_count == 1);
+        REQUIRE(msg.position == Position(1, 2));
+        REQUIRE(logger.contains_warnings());
+    }
+}
+
+TEST_CASE("Execution logger only looks at the level.")
+{
+    auto reporter = TestReporter();
+    auto error_checker = ExecutionLogger();
+    reporter.add_logger(&error_checker);
+    reporter.log(LogLevel::WARNING, L"warning");
+    REQUIRE(static_cast<bool>(error_checker));
+    reporter.log(LogLevel::ERROR, L"error");
+    REQUIRE_FALSE(static_cast<bool>(error_checker));
+}
+
+TEST_CASE("Console logger writes to the given stream.")
+{
+    auto reporter = TestReporter();
+    auto output = std::wostringstream();
+    auto logger = ConsoleLogger(output);
+    reporter.add_logger(&logger);
+    reporter.log(LogLevel::ERROR, L"value: ", 42);
+    REQUIRE(output.str() == L"[ERROR] value: 42\n");
+}
\ No newline at end of file
@@ -112,6 +112,9 @@ std::vector<std::optional<ExprPtr>> make_lambda_vector(Types &&...args)
 #define FUNC(name, params, return_type, block, is_const, position)            \
     std::make_unique<FuncDef>(name, params, return_type, block, is_const,     \
                               position)
+#define EXPORTED_FUNC(name, params, return_type, block, is_const, position)   \
+    std::make_unique<FuncDef>(name, params, return_type, block, is_const,     \
+                              position, true)
 #define EXTERN(name, params, return_type, position)                           \
     std::make_unique<ExternDef>(name, params, return_type, position)
 #define GLOBAL(name, type, initial_value, is_mut, position)                   \
@@ -462,6 +465,19 @@ TEST_CASE("Function definitions.", "[FUNC]")
                         true, POS(1, 1))),
                     EXTERNS()));
     }
+    SECTION("Exported function.")
+    {
+        COMPARE(
+            L"@export fn foo(){}",
+            PROGRAM(GLOBALS(),
+                    FUNCTIONS(EXPORTED_FUNC(L"foo", PARAMS(), NO_TYPE,
+                                            FUNC_BLOCK(STMTS(), POS(1, 17)),
+                                            false, POS(1, 1))),
+                    EXTERNS()));
+        THROWS_ERRORS(L"@foo fn foo(){}");
+        THROWS_ERRORS(L"@export let a = 1;");
+        THROWS_ERRORS(L"@export extern foo();");
+    }
     SECTION("Nested functions.")
     {
         THROWS_ERRORS(L"fn foo(){fn boo(){}}");
@@ -0,0 +1,158 @@
+#include "locale.hpp"
+#include "parser.hpp"
+#include "range_analyzer.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+struct FactCounts
+{
+    std::size_t no_signed_wrap, no_unsigned_wrap, ranges;
+};
+
+FactCounts count_facts(const std::wstring &source)
+{
+    auto locale = Locale("C.utf8");
+    auto parser = Parser(Lexer::from_wstring(source));
+    auto program = parser.parse();
+    auto facts = RangeAnalyzer().analyze(*program);
+    auto result = FactCounts{0, 0, facts.ranges.size()};
+    for (const auto &[node, flags] : facts.wrap_flags)
+    {
+        result.no_signed_wrap += flags.no_signed_wrap;
+        result.no_unsigned_wrap += flags.no_unsigned_wrap;
+    }
+    return result;
+}
+
+TEST_CASE("Constant values.")
+{
+    SECTION("Small values don't wrap in either interpretation.")
+    {
+        auto result = count_facts(L"fn foo() => u32 {"
+                                  L"    let a = 2;"
+                                  L"    let b = a + 3;"
+                                  L"    return b * 4;"
+                                  L"}");
+        REQUIRE(result.no_signed_wrap == 2);
+        REQUIRE(result.no_unsigned_wrap == 2);
+        REQUIRE(result.ranges == 2);
+    }
+    SECTION("Overflowing values wrap.")
+    {
+        auto result = count_facts(L"fn foo() => u32 {"
+                                  L"    let a = 4000000000;"
+                                  L"    return a + a;"
+                                  L"}");
+        REQUIRE(result.no_signed_wrap == 0);
+        REQUIRE(result.no_unsigned_wrap == 0);
+    }
+    SECTION("Shifts of values with the top bit set are sign-filled.")
+    {
+        auto result = count_facts(L"fn foo() => u32 {"
+                                  L"    return (2147483648 >> 1) + 1;"
+                                  L"}");
+        REQUIRE(result.no_signed_wrap == 0);
+        REQUIRE(result.no_unsigned_wrap == 0);
+        REQUIRE(result.ranges == 0);
+    }
+    SECTION("Negative values only don't wrap as signed.")
+    {
+        auto result = count_facts(L"fn foo() => i32 {"
+                                  L"    let a: i32 = -5;"
+                                  L"    return a * (3 as i32);"
+                                  L"}");
+        REQUIRE(result.no_signed_wrap == 1);
+        REQUIRE(result.no_unsigned_wrap == 0);
+    }
+    SECTION("Immutable globals keep their values.")
+    {
+        auto result = count_facts(L"let value = 3;"
+                                  L"fn foo() => u32 {"
+                                  L"    return value + 1;"
+                                  L"}");
+        REQUIRE(result.no_unsigned_wrap == 1);
+    }
+}
+
+TEST_CASE("Unknown values.")
+{
+    SECTION("Parameters can have any value.")
+    {
+        auto result = count_facts(L"fn foo(a: u32) => u32 {"
+                                  L"    return a + 1;"
+                                  L"}");
+        REQUIRE(result.no_signed_wrap == 0);
+        REQUIRE(result.no_unsigned_wrap == 0);
+        REQUIRE(result.ranges == 0);
+    }
+    SECTION("Mutable globals can be changed by any call.")
+    {
+        auto result = count_facts(L"let mut value = 3;"
+                                  L"fn foo() => u32 {"
+                                  L"    return value + 1;"
+                                  L"}");
+        REQUIRE(result.no_unsigned_wrap == 0);
+    }
+    SECTION("Mutably referenced variables aren't tracked.")
+    {
+        auto result = count_facts(L"fn bar(a: &mut u32) {}"
+                                  L"fn foo() => u32 {"
+                                  L"    let mut a = 1;"
+                                  L"    bar(&mut a);"
+                                  L"    return a + 1;"
+                                  L"}");
+        REQUIRE(result.no_unsigned_wrap == 0);
+        REQUIRE(result.ranges == 0);
+    }
+}
+
+TEST_CASE("Control flow.")
+{
+    SECTION("Branches are joined.")
+    {
+        auto result = count_facts(L"fn foo(c: bool) => u32 {"
+                                  L"    let mut a = 1;"
+                                  L"    if (c) {"
+                                  L"        a = 10;"
+                                  L"    }"
+                                  L"    return a * 2;"
+                                  L"}");
+        REQUIRE(result.no_signed_wrap == 1);
+        REQUIRE(result.no_unsigned_wrap == 1);
+        REQUIRE(result.ranges == 2);
+    }
+    SECTION("Loop counters are bounded by the condition.")
+    {
+        auto result = count_facts(L"fn foo(n: u32) {"
+                                  L"    let mut i = 0;"
+                                  L"    while (i < n) {"
+                                  L"        i += 1;"
+                                  L"    }"
+                                  L"}");
+        REQUIRE(result.no_signed_wrap == 0);
+        REQUIRE(result.no_unsigned_wrap == 1);
+    }
+    SECTION("Values assigned in a loop are forgotten.")
+    {
+        auto result = count_facts(L"fn foo(n: u32) => u32 {"
+                                  L"    let mut a = 1;"
+                                  L"    while (n > 0) {"
+                                  L"        a *= 2;"
+                                  L"    }"
+                                  L"    return a;"
+                                  L"}");
+        REQUIRE(result.no_unsigned_wrap == 0);
+        REQUIRE(result.ranges == 0);
+    }
+    SECTION("Match arms narrow the matched variable.")
+    {
+        auto result = count_facts(L"fn foo(a: u32) => u32 {"
+                                  L"    match (a) {"
+                                  L"        1 | 2 => { return a + 1; }"
+                                  L"        else => { return 0; }"
+                                  L"    }"
+                                  L"}");
+        REQUIRE(result.no_signed_wrap == 1);
+        REQUIRE(result.no_unsigned_wrap == 1);
+    }
+}
\ No newline at end of file
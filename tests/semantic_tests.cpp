@@ -1090,4 +1090,78 @@ TEST_CASE("While, break, continue statements.")
                             L"break;"
                             L"}"));
     }
+}
+
+ProgramPtr parse_program(const std::wstring &source)
+{
+    auto parser = Parser(Lexer::from_wstring(source));
+    return parser.parse();
+}
+
+TEST_CASE("Incremental checking.")
+{
+    auto locale = Locale("C.utf8");
+    auto checker = SemanticChecker();
+    auto logger = DebugLogger();
+    checker.add_logger(&logger);
+    auto program = parse_program(L"let mut value: u32 = 3;"
+                                 L"fn foo() => u32 { return value; }"
+                                 L"fn bar() { let a = 2; }"
+                                 L"fn baz() { let b = true; match (b) {} }");
+    checker.check(*program, {});
+    REQUIRE(checker.get_checked_functions().size() == 3);
+    auto warning_count = logger.get_messages().size();
+    REQUIRE(warning_count == 1);
+
+    SECTION("Untouched functions reuse their diagnostics.")
+    {
+        auto changed = std::unordered_set<std::wstring>{L"bar"};
+        checker.check(*program, changed);
+        REQUIRE(checker.get_checked_functions() == changed);
+        REQUIRE(logger.get_messages().size() == 2 * warning_count);
+        REQUIRE(logger.get_messages().back().text() ==
+                logger.get_messages()[warning_count - 1].text());
+    }
+    SECTION("Dependents of changed symbols are checked again.")
+    {
+        auto new_program =
+            parse_program(L"let mut value: i32 = 3;"
+                          L"fn foo() => u32 { return value; }"
+                          L"fn bar() { let a = 2; }"
+                          L"fn baz() { let b = true; match (b) {} }");
+        checker.check(*new_program, {L"value"});
+        REQUIRE(checker.get_checked_functions() ==
+                std::unordered_set<std::wstring>{L"foo"});
+        REQUIRE(logger.contains_errors());
+    }
+    SECTION("New symbols are checked against existing names.")
+    {
+        auto new_program =
+            parse_program(L"let mut value: u32 = 3;"
+                          L"let a = 1;"
+                          L"fn foo() => u32 { return value; }"
+                          L"fn bar() { let a = 2; }"
+                          L"fn baz() { let b = true; match (b) {} }");
+        checker.check(*new_program, {L"a"});
+        REQUIRE(checker.get_checked_functions() ==
+                std::unordered_set<std::wstring>{L"bar"});
+        REQUIRE(logger.contains_errors());
+    }
+    SECTION("Checks that aren't incremental drop the caches.")
+    {
+        checker.check(*program);
+        checker.check(*program, {});
+        REQUIRE(checker.get_checked_functions().size() == 3);
+    }
+    SECTION("Diagnostics below the loggers' levels aren't cached.")
+    {
+        logger.set_min_level(LogLevel::ERROR);
+        checker.check(*program, {L"baz"});
+        REQUIRE(checker.get_checked_functions().size() == 1);
+        logger.set_min_level(LogLevel::INFO);
+        checker.check(*program, {});
+        REQUIRE(checker.get_checked_functions() ==
+                std::unordered_set<std::wstring>{L"baz"});
+        REQUIRE(logger.get_messages().size() == 2 * warning_count);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef __TEST_FILES_HPP__
+#define __TEST_FILES_HPP__
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <string>
+
+// Unique directory which is removed along with its contents once the test
+// ends, even if one of its assertions fails.
+struct TemporaryDirectory
+{
+    std::filesystem::path path;
+
+    TemporaryDirectory()
+    {
+        llvm::SmallString<128> result;
+        REQUIRE(!llvm::sys::fs::createUniqueDirectory("mole-test", result));
+        this->path = result.str().str();
+    }
+
+    TemporaryDirectory(const TemporaryDirectory &) = delete;
+
+    ~TemporaryDirectory()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(this->path, ec);
+    }
+};
+
+inline void write_file(const std::filesystem::path &path,
+                       const std::string &content)
+{
+    auto output = std::ofstream(path, std::ios::binary);
+    output << content;
+}
+
+inline std::string read_file(const std::filesystem::path &path)
+{
+    auto input = std::ifstream(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), {});
+}
+#endif
\ No newline at end of file